@@ -1,11 +1,50 @@
 #pragma once
+// Single header build of UnitTestSystem/, include it into exactly one .cpp file
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <coroutine>
+#include <exception>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <latch>
+#include <mutex>
+#include <thread>
 #include <stdlib.h>
 #include <iostream>
-#include <iomanip>
-#include <functional>
+#include <random>
+#include <stdexcept>
 #include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <array>
+#include <bit>
+#include <fstream>
+#include <memory>
+#include <sys/resource.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#endif
 
 namespace UnitTestSystem
 {
@@ -64,15 +103,31 @@ namespace UnitTestSystem
 
 class MemoryAllocator {
   private:
-    static uint64_t _used_bytes;
+    static std::atomic<uint64_t> _used_bytes;
+    static thread_local uint64_t _untracked_scopes;
     MemoryAllocator() {}
   public:
+    // Allocations made inside this scope are not counted, so the framework can keep
+    // its own bookkeeping alive past the end of a test without reporting it as a leak
+    class UntrackedScope {
+      public:
+        UntrackedScope() { ++_untracked_scopes; }
+        ~UntrackedScope() { --_untracked_scopes; }
+    };
+    
+    // Marks an allocation header as untracked
+    static constexpr size_t UntrackedFlag = (size_t)1 << (sizeof(size_t) * 8 - 1);
+    
+    static bool IsTracking() {
+        return _untracked_scopes == 0;
+    }
+    
     static void AddUsedBytes(uint64_t bytes) {
-        _used_bytes += bytes;
+        _used_bytes.fetch_add(bytes, std::memory_order_relaxed);
     }
     
     static void RemoveUsedBytes(uint64_t bytes) {
-        _used_bytes -= bytes;
+        _used_bytes.fetch_sub(bytes, std::memory_order_relaxed);
     }
     
     static void ResetUsedBytes() {
@@ -83,29 +138,232 @@ class MemoryAllocator {
         return _used_bytes;
     }
 };
-uint64_t MemoryAllocator::_used_bytes = 0;
 
 } // namespace UnitTestSystem
 
-void * operator new(size_t n)
+namespace UnitTestSystem
 {
-    void* ptr = malloc(n + sizeof(n));
-    size_t* dataPtr = (size_t*)ptr;
-    dataPtr[0] = n;
-    ptr = (void*)(++dataPtr);
-    UnitTestSystem::MemoryAllocator::AddUsedBytes(n);
-    return ptr;
-}
 
-void operator delete(void * ptr) throw()
+struct Options {
+    uint64_t repeat = 1; // 0 with untilFail means "repeat until something fails"
+    bool shuffle = false;
+    uint64_t seed = 0;
+    bool untilFail = false;
+    std::vector<size_t> benchmarkThreads; // empty means powers of two up to the benchmark's own limit
+    uint64_t benchmarkOperations = 10000; // per thread
+    size_t coroutineThreads = 1; // threads driving the event loop of TEST_COROUTINE functions
+    std::string tracePath; // Chrome trace-event JSON written at exit, empty means no tracing
+    bool updateSnapshots = false; // MUST_MATCH_SNAPSHOT rewrites golden files instead of comparing
+    uint64_t propertyCases = 1000; // per PROPERTY_TEST
+    uint64_t propertyMilliseconds = 1000; // per PROPERTY_TEST, 0 means no time limit
+    size_t propertyThreads = 0; // 0 means one per hardware thread
+    std::string propertySeedTest; // PROPERTY_TEST that replays only the case with propertySeed
+    uint64_t propertySeed = 0;
+
+    // Supported arguments: --repeat N, --shuffle, --seed S, --until-fail,
+    // --benchmark-threads 1,2,4,8, --benchmark-ops N, --coroutine-threads N, --trace path,
+    // --update-snapshots, --property-cases N, --property-ms N, --property-threads N, --property-seed Name:S
+    static Options Parse(int argc, const char* argv[]);
+
+  private:
+    // Comma separated counts, throws std::invalid_argument unless all of them are at least 1
+    static std::vector<size_t> ParseList(const std::string& text);
+};
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+// Chrome trace-event / Perfetto timeline, enabled by --trace path and written when the program exits.
+// Every thread appends to its own buffer without locking; names must outlive the program (string literals).
+class Trace {
+  private:
+    static bool _isEnabled;
+  public:
+    static bool IsEnabled() { return _isEnabled; }
+    static void Enable(const std::string& path);
+
+    // Nanoseconds since the trace started
+    static uint64_t GetTimestamp();
+
+    static void AddEvent(const char* name, const char* category, uint64_t start, uint64_t end);
+    // For work that overlaps on one thread, e.g. coroutine tests in flight together
+    static void AddAsyncEvent(const char* name, const char* category, uint64_t start, uint64_t end);
+};
+
+class TraceScope {
+  private:
+    const char* _name;
+    uint64_t _start = 0;
+  public:
+    TraceScope(const char* name) : _name(name) {
+        if (Trace::IsEnabled())
+            _start = Trace::GetTimestamp();
+    }
+
+    ~TraceScope() {
+        if (Trace::IsEnabled())
+            Trace::AddEvent(_name, "scope", _start, Trace::GetTimestamp());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+// Process-wide counters from getrusage and procfs. Unlike the operator new hook they also see mmap'd memory,
+// malloc from C libraries and CPU time of every thread the test starts.
+struct ResourceUsage {
+    uint64_t userNanoseconds = 0;
+    uint64_t systemNanoseconds = 0;
+    uint64_t peakResidentBytes = 0; // growth of the peak RSS over the RSS the test started with
+    uint64_t minorFaults = 0;
+    uint64_t majorFaults = 0;
+    uint64_t voluntarySwitches = 0;
+    uint64_t involuntarySwitches = 0;
+
+    uint64_t GetCpuNanoseconds() const { return userNanoseconds + systemNanoseconds; }
+
+    // Sums the counters of several iterations and keeps the largest peak
+    void Add(const ResourceUsage& other);
+    std::string ToString() const;
+};
+
+// Zero means no limit
+struct ResourceLimits {
+    uint64_t maxPeakResidentBytes = 0;
+    uint64_t maxCpuNanoseconds = 0;
+
+    bool IsAnySet() const { return maxPeakResidentBytes > 0 || maxCpuNanoseconds > 0; }
+
+    // Empty if the usage is within the limits
+    std::string GetViolation(const ResourceUsage& usage) const;
+};
+
+class ResourceMeter {
+  private:
+    ResourceUsage _start;
+    uint64_t _startResidentBytes = 0;
+    bool _isPeakReset = false;
+  public:
+    void Start();
+    ResourceUsage Stop() const;
+};
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
 {
-    size_t* dataPtr = (size_t*)ptr;
-    --dataPtr;
-    size_t n = *dataPtr;
-    ptr = (void*)(dataPtr);
-    UnitTestSystem::MemoryAllocator::RemoveUsedBytes(n);
-    free(ptr);
-}
+
+class EventLoop;
+
+// Return type of coroutine test functions and of coroutines they co_await.
+// Owns the coroutine frame; the frame starts suspended and is resumed by the EventLoop.
+class Task {
+  public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        EventLoop* loop = nullptr;
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+        std::chrono::high_resolution_clock::time_point start;
+        std::chrono::high_resolution_clock::time_point finish;
+
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    // Awaiting a Task runs it on the same loop and resumes the caller when it finishes
+    struct Awaiter {
+        Handle handle;
+
+        bool await_ready() { return false; }
+        Handle await_suspend(Handle caller) {
+            handle.promise().loop = caller.promise().loop;
+            handle.promise().continuation = caller;
+            return handle;
+        }
+        void await_resume() {
+            if (handle.promise().exception)
+                std::rethrow_exception(handle.promise().exception);
+        }
+    };
+  private:
+    Handle _handle;
+  public:
+    explicit Task(Handle handle) : _handle(handle) {}
+    Task(Task&& other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    Awaiter operator co_await() { return Awaiter{_handle}; }
+
+    Handle GetHandle() const { return _handle; }
+};
+
+// co_await Sleep(10ms) suspends the test without blocking a loop thread
+class Sleep {
+  private:
+    std::chrono::nanoseconds _duration;
+  public:
+    explicit Sleep(std::chrono::nanoseconds duration) : _duration(duration) {}
+
+    bool await_ready() const { return _duration.count() <= 0; }
+    void await_suspend(Task::Handle handle) const;
+    void await_resume() const {}
+};
+
+// co_await Yield() lets other in-flight tests run
+class Yield {
+  public:
+    bool await_ready() const { return false; }
+    void await_suspend(Task::Handle handle) const;
+    void await_resume() const {}
+};
+
+// Bridges callback based async code: co_await event resumes the coroutine once Set() is called from any thread.
+// Only one coroutine may wait on an Event.
+class Event {
+  private:
+    std::atomic<void*> _state = nullptr; // nullptr, the "set" marker or the address of the waiting coroutine
+    EventLoop* _loop = nullptr;
+  public:
+    void Set();
+
+    bool await_ready() const;
+    bool await_suspend(Task::Handle handle);
+    void await_resume() {}
+};
+
+struct CoroutineOutcome {
+    uint64_t nanoseconds = 0;
+    std::exception_ptr exception;
+};
+
+// Starts all coroutines at once so I/O bound tests overlap, and waits until every one of them finishes
+std::vector<CoroutineOutcome> RunCoroutines(const std::vector<Task (*)()>& coroutines, size_t threadsCount);
+
+} // namespace UnitTestSystem
 
 namespace UnitTestSystem
 {
@@ -118,7 +376,7 @@ struct Error {
     Error() {}
     Error(uint64_t line, const std::string& code, const std::string& message)
     : line(line), code(code), message(message) {}
-    
+
     bool Empty() const { return (line == 0) && code.empty() && message.empty(); }
     bool NotEmpty() const { return !Empty(); }
 };
@@ -126,7 +384,7 @@ struct Error {
 struct Assert {
     uint64_t line;
     std::string code;
-    
+
     Assert(uint64_t line, const std::string& code)
     : line(line), code(code) {}
 };
@@ -136,176 +394,113 @@ struct FunctionResult {
     Error error;
     uint64_t timeElapsedNanoseconds = 0;
     bool isTimeMeasuring = false;
-    
+
+    uint64_t iterationsCount = 0;
+    uint64_t failedIterationsCount = 0;
+    uint64_t minIterationNanoseconds = 0;
+    uint64_t maxIterationNanoseconds = 0;
+
+    // Summed over the iterations of time measuring tests and tests with limits, printed for the former.
+    // Coroutine tests are not measured.
+    ResourceUsage resources;
+    bool isResourceMeasured = false;
+
+    // Extra report lines printed under the result, e.g. benchmark tables
+    std::vector<std::string> details;
+
+    // Keeps the first error, so a flaky function reports its first failure and how often it failed
+    void AddIteration(uint64_t nanoseconds, const Error& iterationError);
+
     bool IsPrint() const { return IsFailed() || (IsSuccess() && isTimeMeasuring);}
     bool IsSuccess() const { return error.Empty(); }
     bool IsFailed() const { return !IsSuccess(); }
-    
-    std::string GetMessage(size_t longestNameLength, size_t longestDescriptionLength) const
-    {
-        if (!IsPrint())
-            return "";
-        
-        std::stringstream ss;
-        
-        const auto description = GetDescription();
-        const auto extra = GetExtra();
-        const std::string arrow = " <-- ";
-        
-        ss << name << std::setw((int)(longestNameLength + 1 - name.length())) << ' ';
-        ss << description << std::setw((int)(longestDescriptionLength + arrow.length() - description.length())) << arrow << extra << '\n';
-            
-        return ss.str();
-    }
-    
-    std::string GetDescription() const
-    {
-        if (IsFailed()) {
-            std::stringstream ss;
-            ss << "FAILED Line " << error.line << ": " << error.code;
-            return ss.str();
-        } else {
-            return "PASSED ";
-        }
-        
-    }
-    
-    std::string GetExtra() const
-    {
-        if (IsFailed()) {
-            return error.message;
-        } else {
-            std::stringstream ss;
-            ss << (double)timeElapsedNanoseconds / 1e6 << "ms elapsed";
-            return ss.str();
-        }
-    }
+
+    std::string GetMessage(size_t longestNameLength, size_t longestDescriptionLength) const;
+    std::string GetDescription() const;
+    std::string GetExtra() const;
+};
+
+// Static-storage descriptor of a single test function. Registration only links it
+// into the module's intrusive list, so nothing is allocated before main.
+struct FunctionInfo {
+    const char* name;
+    void (*function)() = nullptr;
+    Task (*coroutine)() = nullptr;
+    bool timeMeasuring;
+    ResourceLimits limits = {};
+    FunctionInfo* next = nullptr;
 };
 
 template <class T>
 class FunctionRegister {
+  private:
+    FunctionInfo _info;
   public:
-    FunctionRegister(const std::string& name, const std::function<void()>& testFunction, bool timeMeasuring) {
-        T::AddTestFunction(name, testFunction, timeMeasuring);
+    FunctionRegister(const char* name, void (*testFunction)(), bool timeMeasuring, ResourceLimits limits = ResourceLimits())
+    : _info{name, testFunction, nullptr, timeMeasuring, limits} {
+        T::AddTestFunction(&_info);
     }
+
+    FunctionRegister(const char* name, Task (*testCoroutine)(), bool timeMeasuring)
+    : _info{name, nullptr, testCoroutine, timeMeasuring} {
+        T::AddTestFunction(&_info);
+    }
+};
+
+// Gives code running inside a test function access to the runner's state
+class TestContext {
+  private:
+    friend class Runner;
+
+    static const Options* _options;
+    static FunctionResult* _currentResult;
+  public:
+    static const Options& GetOptions();
+    static void AddDetail(const std::string& detail);
+};
+
+// Runs and prints a module. It is compiled once in TestClassBase.cpp instead of in every test file.
+class Runner {
+  public:
+    static void Run(const char* moduleName, const FunctionInfo* firstFunction, const Options& options);
+    // Error, Assert or anything else thrown by a test, as it is reported
+    static Error GetError(const std::exception_ptr& exception);
+  private:
+    struct Stats;
+
+    static std::vector<FunctionResult> RunAndGetResults(const FunctionInfo* firstFunction, const Options& options);
+    static bool RunIteration(const FunctionInfo& function, FunctionResult& result);
+    static bool RunCoroutinesIteration(const std::vector<const FunctionInfo*>& functions,
+                                       const std::vector<size_t>& indices,
+                                       std::vector<FunctionResult>& results,
+                                       const Options& options);
+    static Stats GetStats(const std::vector<FunctionResult>& results);
+    static void PrintLine(size_t count);
 };
 
 template <class T>
 class Base {
   private:
     friend class FunctionRegister<T>;
-    
-    struct FunctionInfo {
-        std::string name;
-        std::function<void()> function;
-        bool timeMeasuring;
-    };
-    static inline std::vector<FunctionInfo> _functionsInfo;
-    
-    static void AddTestFunction(const std::string& name, const std::function<void()>& testFunction, bool timeMeasuring) {
-        _functionsInfo.push_back({name, testFunction, timeMeasuring});
+
+    static inline FunctionInfo* _firstFunction = nullptr;
+    static inline FunctionInfo* _lastFunction = nullptr;
+
+    static void AddTestFunction(FunctionInfo* function) {
+        if (_lastFunction)
+            _lastFunction->next = function;
+        else
+            _firstFunction = function;
+        _lastFunction = function;
     }
   public:
-    static void Run() {
-        const auto results = RunAndGetResults();
-        const auto stats = GetStats(results);
-        
-        std::cout << T::GetName() << ": ";
-        std::cout << "( " << stats.successfulCount << " / " << stats.allCount << " )"
-        << " in " << (double)stats.timeElapsed / 1e9 << "s " << (stats.IsSuccess() ? "PASSED\n": "FAILED\n");
-        
-        const auto lineLength = 6 + stats.longestNameLength + stats.longestDescriptionLength + stats.longestExtraLength;
-        PrintLine(lineLength);
-        for (const auto& result : results)
-            std::cout << result.GetMessage(stats.longestNameLength, stats.longestDescriptionLength);
-        PrintLine(lineLength);
-        std::cout << std::endl;
-    }
-  private:
-    static std::vector<FunctionResult> RunAndGetResults() {
-        std::vector<FunctionResult> results;
-        Timer timer;
-        
-        for (const auto& info : _functionsInfo) {
-            FunctionResult result;
-            result.name = info.name;
-            result.isTimeMeasuring = info.timeMeasuring;
-            
-            MemoryAllocator::ResetUsedBytes();
-            timer.Restart();
-            
-            try { info.function(); }
-            catch (const Error& error) { result.error = error; }
-            catch (const Assert& assert) {
-                Error error(assert.line, assert.code, "Assert triggered!");
-                result.error = error;
-            }
-            catch (...) {
-                Error error(0, "", "Unknown exception occured!");
-                result.error = error;
-            }
-            
-            result.timeElapsedNanoseconds = timer.GetNanoseconds();
-            
-            if (result.IsSuccess()) {
-                const auto bytesLeaked = MemoryAllocator::GetUsedBytes();
-                if (bytesLeaked > 0){
-                    Error error(0, "", "Memory leak: " + std::to_string(bytesLeaked) + " byte(s)");
-                    result.error = error;
-                }
-            }
-            
-            results.push_back(result);
-        }
-            
-        return results;
-    }
-    
-    struct Stats {
-        size_t allCount = 0;
-        size_t successfulCount = 0;
-        uint64_t timeElapsed = 0;
-        size_t longestNameLength = 0;
-        size_t longestDescriptionLength = 0;
-        size_t longestExtraLength = 0;
-        
-        bool IsSuccess() const {
-            return successfulCount == allCount;
-        }
-    };
-    
-    static Stats GetStats(const std::vector<FunctionResult>& results) {
-        Stats stats;
-        stats.allCount = results.size();
-        
-        for (const auto& result : results) {
-            if (result.IsSuccess())
-                ++stats.successfulCount;
-            stats.timeElapsed += result.timeElapsedNanoseconds;
-            stats.longestNameLength = std::max(stats.longestNameLength, result.name.length());
-            stats.longestDescriptionLength = std::max(stats.longestDescriptionLength, result.GetDescription().length());
-            stats.longestExtraLength = std::max(stats.longestExtraLength, result.GetExtra().length());
-        }
-        
-        return stats;
-    }
-    
-    static void PrintLine(size_t count) {
-        for (size_t i = 0; i < count; ++i)
-            std::cout << "=";
-        std::cout << '\n';
+    static void Run(const Options& options = Options()) {
+        Runner::Run(T::GetName(), _firstFunction, options);
     }
 };
 
-void MustBeTrue(bool a, uint64_t line, const std::string& code) {
-    if (!a)
-        throw Error(line, code, "Expected True but was False");
-}
-
-void MustBeFalse(bool a, uint64_t line, const std::string& code) {
-    if (a)
-        throw Error(line, code, "Expected False but was True");
-}
+void MustBeTrue(bool a, uint64_t line, const std::string& code);
+void MustBeFalse(bool a, uint64_t line, const std::string& code);
 
 template <class T1, class T2>
 void MustBeEqual(T1 a, T2 b, uint64_t line, const std::string& aCode, const std::string& bCode) {
@@ -313,67 +508,1810 @@ void MustBeEqual(T1 a, T2 b, uint64_t line, const std::string& aCode, const std:
         throw Error(line, aCode + " == " + bCode, std::to_string(a) + " != " + std::to_string(b));
 }
 
-void MustBeCloseDoubles(double a, double b, uint64_t line, const std::string& aCode, const std::string& bCode) {
-    if (fabs(a - b) > std::max(fabs(a), fabs(b)) * 1e-5)
-        throw Error(line, aCode + " ~= " + bCode, std::to_string(a) + " != " + std::to_string(b));
-}
+void MustBeCloseDoubles(double a, double b, uint64_t line, const std::string& aCode, const std::string& bCode);
 
 } // namespace UnitTestSystem
 
-#define ASSERT(exp) if(!(exp)) throw UnitTestSystem::Assert(__LINE__, #exp)
+namespace UnitTestSystem
+{
 
-#define TEST_MODULE(name)                                                                                          \
-class name : public UnitTestSystem::Base<name> {                                                                   \
-  public:                                                                                                          \
-    static std::string GetName() { return #name; }                                                                 \
-};                                                                                                                 \
-namespace UnitTestSystem::internal_namespace_##name  {                                                             \
-using CurrentModule = name;                                                                                        \
-}                                                                                                                  \
-namespace UnitTestSystem::internal_namespace_##name                                                                \
+// Runs the same function on threadsCount threads that start together, at least one, see STRESS_FUNCTION
+void RunStress(void (*function)(), size_t threadsCount);
 
-#define TEST_FUNCTION_BASE(name, timeMeasuring)                                                                    \
-void name();                                                                                                       \
-static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, name, timeMeasuring);                \
-void name()                                                                                                        \
+} // namespace UnitTestSystem
 
-#define TEST_FUNCTION(name) TEST_FUNCTION_BASE(name, false)
-#define TEST_FUNCTION_TIME_MEASURING(name) TEST_FUNCTION_BASE(name, true)
+namespace UnitTestSystem
+{
 
+// Runs the operation benchmarkOperations times on every thread for each thread count of the sweep
+// and reports throughput, scaling efficiency against the first thread count and merged latency percentiles.
+// Each thread runs its batch twice: untimed for throughput, then timing every operation for latencies.
+void RunThroughputBenchmark(void (*operation)(), size_t maxThreadsCount);
 
-#define MUST_BE_TRUE(exp) MustBeTrue(exp, __LINE__, #exp)
-#define MUST_BE_FALSE(exp) MustBeFalse(exp, __LINE__, #exp)
+} // namespace UnitTestSystem
 
-#define MUST_BE_EQUAL(a, b) MustBeEqual(a, b, __LINE__, #a, #b)
-#define MUST_BE_CLOSE_DOUBLES(a, b) MustBeCloseDoubles(a, b, __LINE__, #a, #b)
+namespace UnitTestSystem
+{
 
-#define MUST_THROW_EXCEPTION(...)                                                                                  \
-try {                                                                                                              \
-    __VA_ARGS__;                                                                                                   \
-    throw Error(__LINE__, #__VA_ARGS__, "There were no exceptions");                                               \
-}                                                                                                                  \
-catch(const Error& e) {throw;}                                                                                     \
-catch(...) { }'.'                                                                                                  \
-//This character '.' is to force user to write MUST_THROW_EXCEPTION(...); <- with semicolon at the end
+enum class Complexity { O1, OLogN, ON, ONLogN, ON2 };
 
-#define MUST_THROW_SPECIFIC_EXCEPTION(exceptionClass, ...)                                                         \
-try {                                                                                                              \
-    __VA_ARGS__;                                                                                                   \
-    throw Error(__LINE__, #__VA_ARGS__, "There were no exceptions");                                               \
-}                                                                                                                  \
-catch(const Error& e) {throw;}                                                                                     \
-catch(const exceptionClass& e) { }                                                                                 \
-catch(...){ throw Error( __LINE__,                                                                                 \
-                         #__VA_ARGS__,                                                                             \
-                         std::string("There were no exceptions of type ") + std::string(#exceptionClass)); }'.'    \
-//This character '.' is to force user to write MUST_THROW_SPECIFIC_EXCEPTION(exeption_class, ...); <- with semicolon at the end
+const char* ToString(Complexity complexity);
+double GetComplexityFactor(Complexity complexity, double n);
 
-#define MUST_ASSERT(...)                                                                                           \
-try {                                                                                                              \
-    __VA_ARGS__;                                                                                                   \
-    throw Error(__LINE__, #__VA_ARGS__, "There were no assert triggers");                                          \
-}                                                                                                                  \
-catch(const Error& e) {throw;}                                                                                     \
-catch(const UnitTestSystem::Assert& e) { }                                                                         \
-catch(...){throw;}'.'                                                                                              \
-//This character '.' is to force user to write MUST_ASSERT(...); <- with semicolon at the end
+struct ComplexityFit {
+    Complexity complexity = Complexity::O1;
+    double coefficient = 0;
+    double relativeError = 0; // RMS of residuals relative to the measured times
+};
+
+// Least squares fit of time = coefficient * f(n) for every class, on residuals relative to the measured time
+// so that small sizes count as much as large ones. The class with the smallest error wins, except that the declared
+// class is kept while its own error is small and close to the best, otherwise measurement noise would often "prove"
+// O(n log n) for O(n) code. No other class gets that benefit, so worse than declared code can't hide behind it.
+ComplexityFit FitComplexity(const std::vector<size_t>& sizes, const std::vector<double>& times, Complexity declared);
+
+// Lets a complexity benchmark exclude its setup: only the time after the last Restart() is measured
+class ComplexityTimer {
+  private:
+    static thread_local Timer* _timer;
+  public:
+    class Scope {
+      public:
+        Scope(Timer& timer) { _timer = &timer; }
+        ~Scope() { _timer = nullptr; }
+    };
+
+    static void Restart();
+};
+
+// Fails with Error at line when the measured times fit a worse class than the declared one,
+// or when there are fewer than 3 distinct positive sizes
+void CheckComplexity(void (*function)(size_t), Complexity declared, const std::vector<size_t>& sizes, uint64_t line);
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+// Compares the data with the golden file at path without loading it: the file is memory-mapped and compared
+// in chunks. The first difference is reported with a hex/text window of both sides. With --update-snapshots
+// the golden file is rewritten instead, through a temporary file renamed over it.
+void MustMatchSnapshot(const void* data, size_t size, const std::string& path, uint64_t line, const std::string& code);
+
+// Any contiguous container: std::string, std::string_view, std::vector, std::array...
+template <class Buffer>
+void MustMatchSnapshot(const Buffer& buffer, const std::string& path, uint64_t line, const std::string& code) {
+    MustMatchSnapshot(buffer.data(), buffer.size() * sizeof(*buffer.data()), path, line, code);
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+// SplitMix64. Unlike <random> distributions it gives the same cases for a seed on every standard library.
+class PropertyRandom {
+  private:
+    uint64_t _state;
+  public:
+    explicit PropertyRandom(uint64_t seed) : _state(seed) {}
+
+    uint64_t Next() {
+        auto z = (_state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, max]
+    uint64_t Next(uint64_t max) {
+        return max == UINT64_MAX ? Next() : Next() % (max + 1);
+    }
+};
+
+// A generator has a Value type, Generate(random), Shrink(value) listing simpler candidates, most aggressive first,
+// and ToString(value) for the report. Invalid bounds throw Error, which fails the property test.
+template <class T>
+class IntegerGenerator {
+  private:
+    T _min;
+    T _max;
+  public:
+    using Value = T;
+
+    IntegerGenerator(T min, T max) : _min(min), _max(max) {
+        if (min > max)
+            throw Error(0, "", "IntegerGenerator: min is greater than max");
+    }
+
+    T Generate(PropertyRandom& random) const {
+        return (T)((uint64_t)_min + random.Next((uint64_t)_max - (uint64_t)_min));
+    }
+
+    // Towards zero, or towards the bound closest to it
+    std::vector<T> Shrink(T value) const {
+        const T target = (_min > 0) ? _min : ((_max < 0) ? _max : 0);
+        std::vector<T> candidates;
+        if (value == target)
+            return candidates;
+
+        candidates.push_back(target);
+        const T half = value - (value - target) / 2;
+        if (half != value && half != target)
+            candidates.push_back(half);
+        const T step = (value > target) ? value - 1 : value + 1;
+        if (step != target && step != half)
+            candidates.push_back(step);
+        return candidates;
+    }
+
+    std::string ToString(T value) const { return std::to_string(value); }
+};
+
+// Drops the first or second half, then single elements, but never goes below minLength
+template <class Sequence>
+std::vector<Sequence> ShrinkSequence(const Sequence& value, size_t minLength) {
+    std::vector<Sequence> candidates;
+    const auto length = value.size();
+    if (length <= minLength)
+        return candidates;
+
+    const auto half = std::max(length / 2, minLength);
+    if (half < length) {
+        candidates.emplace_back(value.begin(), value.begin() + half);
+        candidates.emplace_back(value.end() - half, value.end());
+    }
+    for (size_t i = 0; i < length; ++i) {
+        candidates.push_back(value);
+        candidates.back().erase(candidates.back().begin() + i);
+    }
+    return candidates;
+}
+
+// Printable ASCII
+class StringGenerator {
+  private:
+    size_t _minLength;
+    size_t _maxLength;
+  public:
+    using Value = std::string;
+
+    StringGenerator(size_t minLength, size_t maxLength) : _minLength(minLength), _maxLength(maxLength) {
+        if (minLength > maxLength)
+            throw Error(0, "", "StringGenerator: minLength is greater than maxLength");
+    }
+
+    std::string Generate(PropertyRandom& random) const {
+        std::string value(_minLength + random.Next(_maxLength - _minLength), ' ');
+        for (auto& character : value)
+            character = (char)(' ' + random.Next('~' - ' '));
+        return value;
+    }
+
+    std::vector<std::string> Shrink(const std::string& value) const {
+        auto candidates = ShrinkSequence(value, _minLength);
+        for (size_t i = 0; i < value.length(); ++i) {
+            if (value[i] != 'a') {
+                candidates.push_back(value);
+                candidates.back()[i] = 'a';
+            }
+        }
+        return candidates;
+    }
+
+    std::string ToString(const std::string& value) const { return '"' + value + '"'; }
+};
+
+template <class ElementGenerator>
+class VectorGenerator {
+  private:
+    ElementGenerator _element;
+    size_t _minLength;
+    size_t _maxLength;
+  public:
+    using Element = typename ElementGenerator::Value;
+    using Value = std::vector<Element>;
+
+    VectorGenerator(ElementGenerator element, size_t minLength, size_t maxLength)
+    : _element(element), _minLength(minLength), _maxLength(maxLength) {
+        if (minLength > maxLength)
+            throw Error(0, "", "VectorGenerator: minLength is greater than maxLength");
+    }
+
+    Value Generate(PropertyRandom& random) const {
+        Value value(_minLength + random.Next(_maxLength - _minLength));
+        for (auto& element : value)
+            element = _element.Generate(random);
+        return value;
+    }
+
+    std::vector<Value> Shrink(const Value& value) const {
+        auto candidates = ShrinkSequence(value, _minLength);
+        for (size_t i = 0; i < value.size(); ++i) {
+            for (auto& element : _element.Shrink(value[i])) {
+                candidates.push_back(value);
+                candidates.back()[i] = std::move(element);
+            }
+        }
+        return candidates;
+    }
+
+    std::string ToString(const Value& value) const {
+        std::string text = "[";
+        for (size_t i = 0; i < value.size(); ++i)
+            text += (i == 0 ? "" : ", ") + _element.ToString(value[i]);
+        return text + "]";
+    }
+};
+
+struct PropertyCases {
+    uint64_t count = 0;
+    bool isFailed = false;
+    uint64_t failedSeed = 0;
+};
+
+// Runs runCase(context, caseSeed) on worker threads until --property-cases or --property-ms runs out, or replays
+// only the seed of --property-seed if it names this test. runCase returns false when the property doesn't hold.
+PropertyCases RunPropertyCases(const char* name, bool (*runCase)(const void* context, uint64_t seed), const void* context);
+
+template <class Generators>
+struct PropertyValuesOf;
+
+template <class... Generators>
+struct PropertyValuesOf<std::tuple<Generators...>> {
+    using Type = std::tuple<typename Generators::Value...>;
+};
+
+template <class Generators>
+using PropertyValues = typename PropertyValuesOf<Generators>::Type;
+
+template <class... Generators>
+class PropertyChecker {
+  public:
+    using Values = std::tuple<typename Generators::Value...>;
+  private:
+    static constexpr uint64_t MaxShrinksCount = 10000;
+
+    const char* _name;
+    std::tuple<Generators...> _generators;
+    void (*_function)(const Values&);
+
+    Values Generate(uint64_t seed) const {
+        PropertyRandom random(seed);
+        // Braced initialization generates the values left to right
+        return std::apply([&random](const auto&... generators) { return Values{generators.Generate(random)...}; },
+                          _generators);
+    }
+
+    // Empty if the property holds
+    Error Check(const Values& values) const {
+        try { _function(values); }
+        catch (...) { return Runner::GetError(std::current_exception()); }
+        return Error();
+    }
+
+    static bool RunCase(const void* context, uint64_t seed) {
+        const auto checker = (const PropertyChecker*)context;
+        return checker->Check(checker->Generate(seed)).Empty();
+    }
+
+    template <size_t Index>
+    bool ShrinkValue(Values& values, Error& error) const {
+        for (auto& candidate : std::get<Index>(_generators).Shrink(std::get<Index>(values))) {
+            auto shrunk = values;
+            std::get<Index>(shrunk) = std::move(candidate);
+            auto shrunkError = Check(shrunk);
+            if (shrunkError.NotEmpty()) {
+                values = std::move(shrunk);
+                error = std::move(shrunkError);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Greedy: takes the first simpler candidate that still fails, until none of them fails
+    template <size_t... Indices>
+    uint64_t Shrink(Values& values, Error& error, std::index_sequence<Indices...>) const {
+        uint64_t shrinksCount = 0;
+        while (shrinksCount < MaxShrinksCount && (ShrinkValue<Indices>(values, error) || ...))
+            ++shrinksCount;
+        return shrinksCount;
+    }
+
+    template <size_t... Indices>
+    std::string ToString(const Values& values, std::index_sequence<Indices...>) const {
+        std::string text;
+        ((text += (Indices == 0 ? "" : ", ") + std::get<Indices>(_generators).ToString(std::get<Indices>(values))), ...);
+        return "(" + text + ")";
+    }
+  public:
+    PropertyChecker(const char* name, std::tuple<Generators...> generators, void (*function)(const Values&))
+    : _name(name), _generators(std::move(generators)), _function(function) {}
+
+    void Run() const {
+        const auto cases = RunPropertyCases(_name, RunCase, this);
+        if (!cases.isFailed)
+            return;
+
+        auto values = Generate(cases.failedSeed);
+        auto error = Check(values);
+        const auto seed = std::string(_name) + ":" + std::to_string(cases.failedSeed);
+        if (error.Empty())
+            throw Error(0, "", "Failed once but passed when replayed, seed " + seed);
+
+        const auto shrinksCount = Shrink(values, error, std::index_sequence_for<Generators...>());
+        throw Error(error.line, error.code, error.message + " for " + ToString(values, std::index_sequence_for<Generators...>())
+                    + " after " + std::to_string(shrinksCount) + " shrink(s), replay with --property-seed " + seed);
+    }
+};
+
+} // namespace UnitTestSystem
+
+#define ASSERT(exp) if(!(exp)) throw UnitTestSystem::Assert(__LINE__, #exp)
+
+#define TEST_MODULE(name)                                                                                          \
+class name : public UnitTestSystem::Base<name> {                                                                   \
+  public:                                                                                                          \
+    static const char* GetName() { return #name; }                                                                 \
+};                                                                                                                 \
+namespace UnitTestSystem::internal_namespace_##name  {                                                             \
+using CurrentModule = name;                                                                                        \
+}                                                                                                                  \
+namespace UnitTestSystem::internal_namespace_##name                                                                \
+
+#define TEST_FUNCTION_BASE(name, timeMeasuring)                                                                    \
+void name();                                                                                                       \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, name, timeMeasuring);                \
+void name()                                                                                                        \
+
+#define TEST_FUNCTION(name) TEST_FUNCTION_BASE(name, false)
+#define TEST_FUNCTION_TIME_MEASURING(name) TEST_FUNCTION_BASE(name, true)
+
+// Fails the test when its peak RSS grows by more than maxPeakResidentBytes or it takes more than maxCpuMilliseconds
+// of CPU time (user + system, all threads). 0 disables a limit.
+#define TEST_FUNCTION_WITH_LIMITS(name, maxPeakResidentBytes, maxCpuMilliseconds)                                  \
+void name();                                                                                                       \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, name, false,                         \
+    UnitTestSystem::ResourceLimits{(uint64_t)(maxPeakResidentBytes), (uint64_t)(maxCpuMilliseconds) * 1000000});   \
+void name()                                                                                                        \
+
+// The body must co_await or co_return at least once. Awaitables: Sleep, Yield, Event and other Task coroutines.
+#define TEST_COROUTINE_BASE(name, timeMeasuring)                                                                   \
+UnitTestSystem::Task name();                                                                                       \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, name, timeMeasuring);                \
+UnitTestSystem::Task name()                                                                                        \
+
+#define TEST_COROUTINE(name) TEST_COROUTINE_BASE(name, false)
+#define TEST_COROUTINE_TIME_MEASURING(name) TEST_COROUTINE_BASE(name, true)
+
+#define STRESS_FUNCTION(name, threadsCount)                                                                        \
+void name();                                                                                                       \
+void stress_##name() { UnitTestSystem::RunStress(name, threadsCount); }                                            \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, stress_##name, false);               \
+void name()                                                                                                        \
+
+#define BENCHMARK_THROUGHPUT(name, maxThreadsCount)                                                                \
+void name();                                                                                                       \
+void benchmark_##name() { UnitTestSystem::RunThroughputBenchmark(name, maxThreadsCount); }                         \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, benchmark_##name, true);             \
+void name()                                                                                                        \
+
+// complexity is one of O1, OLogN, ON, ONLogN, ON2; the body gets the input size as n
+#define BENCHMARK_COMPLEXITY(name, complexity, ...)                                                                \
+void name(size_t n);                                                                                               \
+void complexity_##name() {                                                                                         \
+    UnitTestSystem::CheckComplexity(name, UnitTestSystem::Complexity::complexity, {__VA_ARGS__}, __LINE__);        \
+}                                                                                                                  \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, complexity_##name, true);            \
+void name(size_t n)                                                                                                \
+
+
+// Checks the body against many generated inputs. The generators are IntegerGenerator, StringGenerator, VectorGenerator
+// or any class with the same members; the body gets their values as a tuple: const auto& [a, b] = values;
+#define PROPERTY_TEST(name, ...)                                                                                   \
+static auto generators_##name() { return std::make_tuple(__VA_ARGS__); }                                           \
+void name(const UnitTestSystem::PropertyValues<decltype(generators_##name())>& values);                            \
+void property_##name() { UnitTestSystem::PropertyChecker(#name, generators_##name(), name).Run(); }                \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, property_##name, false);             \
+void name(const UnitTestSystem::PropertyValues<decltype(generators_##name())>& values)                             \
+
+// Records the enclosing block as a span on the --trace timeline, the name must be a string literal
+#define TRACE_SCOPE(name) UnitTestSystem::TraceScope TRACE_SCOPE_VARIABLE(__LINE__)(name)
+#define TRACE_SCOPE_VARIABLE(line) TRACE_SCOPE_CONCAT(traceScope_, line)
+#define TRACE_SCOPE_CONCAT(a, b) a##b
+
+#define MUST_BE_TRUE(exp) MustBeTrue(exp, __LINE__, #exp)
+#define MUST_BE_FALSE(exp) MustBeFalse(exp, __LINE__, #exp)
+
+#define MUST_BE_EQUAL(a, b) MustBeEqual(a, b, __LINE__, #a, #b)
+#define MUST_BE_CLOSE_DOUBLES(a, b) MustBeCloseDoubles(a, b, __LINE__, #a, #b)
+#define MUST_MATCH_SNAPSHOT(buffer, path) MustMatchSnapshot(buffer, path, __LINE__, #buffer)
+
+#define MUST_THROW_EXCEPTION(...)                                                                                  \
+try {                                                                                                              \
+    __VA_ARGS__;                                                                                                   \
+    throw Error(__LINE__, #__VA_ARGS__, "There were no exceptions");                                               \
+}                                                                                                                  \
+catch(const Error& e) {throw;}                                                                                     \
+catch(...) { }'.'                                                                                                  \
+//This character '.' is to force user to write MUST_THROW_EXCEPTION(...); <- with semicolon at the end
+
+#define MUST_THROW_SPECIFIC_EXCEPTION(exceptionClass, ...)                                                         \
+try {                                                                                                              \
+    __VA_ARGS__;                                                                                                   \
+    throw Error(__LINE__, #__VA_ARGS__, "There were no exceptions");                                               \
+}                                                                                                                  \
+catch(const Error& e) {throw;}                                                                                     \
+catch(const exceptionClass& e) { }                                                                                 \
+catch(...){ throw Error( __LINE__,                                                                                 \
+                         #__VA_ARGS__,                                                                             \
+                         std::string("There were no exceptions of type ") + std::string(#exceptionClass)); }'.'    \
+//This character '.' is to force user to write MUST_THROW_SPECIFIC_EXCEPTION(exeption_class, ...); <- with semicolon at the end
+
+#define MUST_ASSERT(...)                                                                                           \
+try {                                                                                                              \
+    __VA_ARGS__;                                                                                                   \
+    throw Error(__LINE__, #__VA_ARGS__, "There were no assert triggers");                                          \
+}                                                                                                                  \
+catch(const Error& e) {throw;}                                                                                     \
+catch(const UnitTestSystem::Assert& e) { }                                                                         \
+catch(...){throw;}'.'                                                                                              \
+//This character '.' is to force user to write MUST_ASSERT(...); <- with semicolon at the end
+
+namespace UnitTestSystem
+{
+
+// Runs function(threadIndex) on threadsCount threads that are released together by a start latch.
+// The first exception thrown by any of them is rethrown after all threads are joined.
+template <class Function>
+void RunOnThreads(size_t threadsCount, const Function& function) {
+    std::latch start((ptrdiff_t)threadsCount);
+    std::mutex exceptionMutex;
+    std::exception_ptr firstException;
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadsCount);
+    for (size_t i = 0; i < threadsCount; ++i) {
+        threads.emplace_back([&, i] {
+            start.arrive_and_wait();
+            TraceScope scope("worker");
+            try { function(i); }
+            catch (...) {
+                std::lock_guard lock(exceptionMutex);
+                if (!firstException)
+                    firstException = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (firstException)
+        std::rethrow_exception(firstException);
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+std::atomic<uint64_t> MemoryAllocator::_used_bytes = 0;
+thread_local uint64_t MemoryAllocator::_untracked_scopes = 0;
+
+} // namespace UnitTestSystem
+
+void * operator new(size_t n)
+{
+    void* ptr = malloc(n + sizeof(n));
+    size_t* dataPtr = (size_t*)ptr;
+    ptr = (void*)(dataPtr + 1);
+    if (UnitTestSystem::MemoryAllocator::IsTracking()) {
+        dataPtr[0] = n;
+        UnitTestSystem::MemoryAllocator::AddUsedBytes(n);
+    } else {
+        dataPtr[0] = n | UnitTestSystem::MemoryAllocator::UntrackedFlag;
+    }
+    return ptr;
+}
+
+void operator delete(void * ptr) throw()
+{
+    size_t* dataPtr = (size_t*)ptr;
+    --dataPtr;
+    size_t n = *dataPtr;
+    ptr = (void*)(dataPtr);
+    if ((n & UnitTestSystem::MemoryAllocator::UntrackedFlag) == 0)
+        UnitTestSystem::MemoryAllocator::RemoveUsedBytes(n);
+    free(ptr);
+}
+
+namespace UnitTestSystem
+{
+
+Options Options::Parse(int argc, const char* argv[]) {
+    Options options;
+    bool isRepeatSet = false;
+    bool isSeedSet = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        try {
+            if (argument == "--repeat" && hasValue) {
+                options.repeat = std::stoull(argv[++i]);
+                isRepeatSet = true;
+            } else if (argument == "--shuffle") {
+                options.shuffle = true;
+            } else if (argument == "--seed" && hasValue) {
+                options.seed = std::stoull(argv[++i]);
+                isSeedSet = true;
+            } else if (argument == "--until-fail") {
+                options.untilFail = true;
+            } else if (argument == "--benchmark-threads" && hasValue) {
+                options.benchmarkThreads = ParseList(argv[++i]);
+            } else if (argument == "--benchmark-ops" && hasValue) {
+                const auto operations = std::stoull(argv[++i]);
+                if (operations == 0)
+                    throw std::invalid_argument("0 benchmark operations");
+                options.benchmarkOperations = operations;
+            } else if (argument == "--coroutine-threads" && hasValue) {
+                options.coroutineThreads = std::stoull(argv[++i]);
+            } else if (argument == "--trace" && hasValue) {
+                options.tracePath = argv[++i];
+            } else if (argument == "--update-snapshots") {
+                options.updateSnapshots = true;
+            } else if (argument == "--property-cases" && hasValue) {
+                options.propertyCases = std::stoull(argv[++i]);
+            } else if (argument == "--property-ms" && hasValue) {
+                options.propertyMilliseconds = std::stoull(argv[++i]);
+            } else if (argument == "--property-threads" && hasValue) {
+                options.propertyThreads = std::stoull(argv[++i]);
+            } else if (argument == "--property-seed" && hasValue) {
+                const std::string value = argv[++i];
+                const auto colon = value.rfind(':');
+                if (colon == std::string::npos || colon == 0)
+                    throw std::invalid_argument("expected Name:Seed");
+                options.propertySeed = std::stoull(value.substr(colon + 1));
+                options.propertySeedTest = value.substr(0, colon);
+            } else {
+                std::cerr << "Unknown argument is ignored: " << argument << '\n';
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Invalid argument is ignored: " << argument << ' ' << argv[i] << '\n';
+        }
+    }
+
+    if (options.untilFail && !isRepeatSet)
+        options.repeat = 0;
+    if (options.repeat == 0 && !options.untilFail) {
+        std::cerr << "--repeat 0 needs --until-fail, repeating once\n";
+        options.repeat = 1;
+    }
+    if (!isSeedSet)
+        options.seed = std::random_device()();
+
+    return options;
+}
+
+std::vector<size_t> Options::ParseList(const std::string& text) {
+    std::vector<size_t> values;
+    size_t begin = 0;
+    while (begin < text.length()) {
+        auto end = text.find(',', begin);
+        if (end == std::string::npos)
+            end = text.length();
+        if (end > begin) {
+            values.push_back(std::stoull(text.substr(begin, end - begin)));
+            if (values.back() == 0)
+                throw std::invalid_argument("0 in a list of counts");
+        }
+        begin = end + 1;
+    }
+    return values;
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+void FunctionResult::AddIteration(uint64_t nanoseconds, const Error& iterationError) {
+    minIterationNanoseconds = (iterationsCount == 0) ? nanoseconds : std::min(minIterationNanoseconds, nanoseconds);
+    maxIterationNanoseconds = std::max(maxIterationNanoseconds, nanoseconds);
+    timeElapsedNanoseconds += nanoseconds;
+    ++iterationsCount;
+
+    if (iterationError.NotEmpty()) {
+        ++failedIterationsCount;
+        if (IsSuccess())
+            error = iterationError;
+    }
+}
+
+std::string FunctionResult::GetMessage(size_t longestNameLength, size_t longestDescriptionLength) const
+{
+    if (!IsPrint())
+        return "";
+
+    std::stringstream ss;
+
+    const auto description = GetDescription();
+    const auto extra = GetExtra();
+    const std::string arrow = " <-- ";
+
+    ss << name << std::setw((int)(longestNameLength + 1 - name.length())) << ' ';
+    ss << description << std::setw((int)(longestDescriptionLength + arrow.length() - description.length())) << arrow << extra << '\n';
+    if (IsSuccess() && isResourceMeasured)
+        ss << std::string(longestNameLength + 1, ' ') << resources.ToString() << '\n';
+    for (const auto& detail : details)
+        ss << std::string(longestNameLength + 1, ' ') << detail << '\n';
+
+    return ss.str();
+}
+
+std::string FunctionResult::GetDescription() const
+{
+    if (IsFailed()) {
+        std::stringstream ss;
+        ss << "FAILED Line " << error.line << ": " << error.code;
+        return ss.str();
+    } else {
+        return "PASSED ";
+    }
+}
+
+std::string FunctionResult::GetExtra() const
+{
+    std::stringstream ss;
+    if (IsFailed()) {
+        ss << error.message;
+        if (iterationsCount > 1)
+            ss << " (failed " << failedIterationsCount << " / " << iterationsCount << " iterations)";
+    } else {
+        ss << (double)timeElapsedNanoseconds / 1e6 << "ms elapsed";
+        if (iterationsCount > 1) {
+            ss << " (" << iterationsCount << " iterations, min " << (double)minIterationNanoseconds / 1e6
+            << "ms, max " << (double)maxIterationNanoseconds / 1e6 << "ms)";
+        }
+    }
+    return ss.str();
+}
+
+const Options* TestContext::_options = nullptr;
+FunctionResult* TestContext::_currentResult = nullptr;
+
+const Options& TestContext::GetOptions() {
+    static const Options defaultOptions;
+    return _options ? *_options : defaultOptions;
+}
+
+// Stress and property tests add details from several threads
+static std::mutex detailsMutex;
+
+void TestContext::AddDetail(const std::string& detail) {
+    if (!_currentResult)
+        return;
+    MemoryAllocator::UntrackedScope untracked;
+    std::lock_guard lock(detailsMutex);
+    _currentResult->details.push_back(detail);
+}
+
+struct Runner::Stats {
+    size_t allCount = 0;
+    size_t successfulCount = 0;
+    uint64_t timeElapsed = 0;
+    size_t longestNameLength = 0;
+    size_t longestDescriptionLength = 0;
+    size_t longestExtraLength = 0;
+
+    bool IsSuccess() const {
+        return successfulCount == allCount;
+    }
+};
+
+void Runner::Run(const char* moduleName, const FunctionInfo* firstFunction, const Options& options) {
+    if (!options.tracePath.empty())
+        Trace::Enable(options.tracePath);
+    TraceScope moduleScope(moduleName);
+
+    TestContext::_options = &options;
+    const auto results = RunAndGetResults(firstFunction, options);
+    TestContext::_options = nullptr;
+
+    TraceScope reportScope("report");
+    const auto stats = GetStats(results);
+
+    std::cout << moduleName << ": ";
+    std::cout << "( " << stats.successfulCount << " / " << stats.allCount << " )"
+    << " in " << (double)stats.timeElapsed / 1e9 << "s " << (stats.IsSuccess() ? "PASSED": "FAILED");
+    if (options.shuffle)
+        std::cout << " (shuffled with seed " << options.seed << ")";
+    std::cout << '\n';
+
+    const auto lineLength = 6 + stats.longestNameLength + stats.longestDescriptionLength + stats.longestExtraLength;
+    PrintLine(lineLength);
+    for (const auto& result : results)
+        std::cout << result.GetMessage(stats.longestNameLength, stats.longestDescriptionLength);
+    PrintLine(lineLength);
+    std::cout << std::endl;
+}
+
+std::vector<FunctionResult> Runner::RunAndGetResults(const FunctionInfo* firstFunction, const Options& options) {
+    std::vector<const FunctionInfo*> functions;
+    std::vector<FunctionResult> results;
+    std::vector<size_t> order;
+    {
+        TraceScope setupScope("setup");
+        for (auto info = firstFunction; info; info = info->next)
+            functions.push_back(info);
+        if (functions.empty())
+            return {};
+
+        results.resize(functions.size());
+        for (size_t i = 0; i < functions.size(); ++i) {
+            results[i].name = functions[i]->name;
+            results[i].isTimeMeasuring = functions[i]->timeMeasuring;
+        }
+
+        order.resize(functions.size());
+        std::iota(order.begin(), order.end(), 0);
+    }
+    std::mt19937_64 random(options.seed);
+
+    for (uint64_t iteration = 0; (options.untilFail && options.repeat == 0) || iteration < options.repeat; ++iteration) {
+        if (options.shuffle)
+            std::shuffle(order.begin(), order.end(), random);
+
+        bool isAnyFailed = false;
+        std::vector<size_t> coroutineIndices;
+        for (const auto index : order) {
+            if (functions[index]->coroutine)
+                coroutineIndices.push_back(index);
+            else
+                isAnyFailed |= !RunIteration(*functions[index], results[index]);
+        }
+        if (!coroutineIndices.empty())
+            isAnyFailed |= !RunCoroutinesIteration(functions, coroutineIndices, results, options);
+
+        if (options.untilFail && isAnyFailed)
+            break;
+    }
+
+    return results;
+}
+
+bool Runner::RunIteration(const FunctionInfo& function, FunctionResult& result) {
+    Error error;
+    Timer timer;
+    ResourceMeter meter;
+
+    // Details belong to the reported error, which is the first failing iteration's
+    if (result.IsSuccess())
+        result.details.clear();
+    TestContext::_currentResult = result.IsSuccess() ? &result : nullptr;
+    const auto traceStart = Trace::IsEnabled() ? Trace::GetTimestamp() : 0;
+
+    // Metering costs tens of microseconds, too much for every test of a large binary
+    const bool isMetering = function.timeMeasuring || function.limits.IsAnySet();
+    if (isMetering)
+        meter.Start();
+    MemoryAllocator::ResetUsedBytes();
+    timer.Restart();
+
+    try { function.function(); }
+    catch (...) { error = GetError(std::current_exception()); }
+
+    const auto timeElapsed = timer.GetNanoseconds();
+    const auto usage = isMetering ? meter.Stop() : ResourceUsage();
+    TestContext::_currentResult = nullptr;
+    if (Trace::IsEnabled())
+        Trace::AddEvent(function.name, "test", traceStart, traceStart + timeElapsed);
+
+    if (error.Empty()) {
+        const auto bytesLeaked = MemoryAllocator::GetUsedBytes();
+        if (bytesLeaked > 0)
+            error = Error(0, "", "Memory leak: " + std::to_string(bytesLeaked) + " byte(s)");
+    }
+    if (isMetering && error.Empty()) {
+        const auto violation = function.limits.GetViolation(usage);
+        if (!violation.empty())
+            error = Error(0, "", violation);
+    }
+
+    if (isMetering) {
+        result.resources.Add(usage);
+        result.isResourceMeasured = true;
+    }
+
+    result.AddIteration(timeElapsed, error);
+    return error.Empty();
+}
+
+// All coroutines of the module are in flight together, so their allocations can't be told apart
+// and they are not checked for memory leaks
+bool Runner::RunCoroutinesIteration(const std::vector<const FunctionInfo*>& functions,
+                                    const std::vector<size_t>& indices,
+                                    std::vector<FunctionResult>& results,
+                                    const Options& options) {
+    std::vector<Task (*)()> coroutines;
+    for (const auto index : indices)
+        coroutines.push_back(functions[index]->coroutine);
+
+    const auto traceStart = Trace::IsEnabled() ? Trace::GetTimestamp() : 0;
+    const auto outcomes = RunCoroutines(coroutines, options.coroutineThreads);
+
+    bool isAllSuccess = true;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        const auto error = outcomes[i].exception ? GetError(outcomes[i].exception) : Error();
+        auto& result = results[indices[i]];
+        if (result.IsSuccess())
+            result.details.clear();
+        result.AddIteration(outcomes[i].nanoseconds, error);
+        isAllSuccess &= error.Empty();
+        if (Trace::IsEnabled())
+            Trace::AddAsyncEvent(functions[indices[i]]->name, "coroutine", traceStart, traceStart + outcomes[i].nanoseconds);
+    }
+    return isAllSuccess;
+}
+
+Error Runner::GetError(const std::exception_ptr& exception) {
+    try { std::rethrow_exception(exception); }
+    catch (const Error& error) { return error; }
+    catch (const Assert& assert) {
+        return Error(assert.line, assert.code, "Assert triggered!");
+    }
+    catch (...) {
+        return Error(0, "", "Unknown exception occured!");
+    }
+}
+
+Runner::Stats Runner::GetStats(const std::vector<FunctionResult>& results) {
+    Stats stats;
+    stats.allCount = results.size();
+
+    for (const auto& result : results) {
+        if (result.IsSuccess())
+            ++stats.successfulCount;
+        stats.timeElapsed += result.timeElapsedNanoseconds;
+        stats.longestNameLength = std::max(stats.longestNameLength, result.name.length());
+        stats.longestDescriptionLength = std::max(stats.longestDescriptionLength, result.GetDescription().length());
+        stats.longestExtraLength = std::max(stats.longestExtraLength, result.GetExtra().length());
+    }
+
+    return stats;
+}
+
+void Runner::PrintLine(size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        std::cout << "=";
+    std::cout << '\n';
+}
+
+void MustBeTrue(bool a, uint64_t line, const std::string& code) {
+    if (!a)
+        throw Error(line, code, "Expected True but was False");
+}
+
+void MustBeFalse(bool a, uint64_t line, const std::string& code) {
+    if (a)
+        throw Error(line, code, "Expected False but was True");
+}
+
+void MustBeCloseDoubles(double a, double b, uint64_t line, const std::string& aCode, const std::string& bCode) {
+    if (fabs(a - b) > std::max(fabs(a), fabs(b)) * 1e-5)
+        throw Error(line, aCode + " ~= " + bCode, std::to_string(a) + " != " + std::to_string(b));
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+// Resumes ready coroutines and expired sleeps on one or more threads until every started task finishes
+class EventLoop {
+  private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct SleepingCoroutine {
+        Clock::time_point wakeUpTime;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const SleepingCoroutine& other) const { return wakeUpTime > other.wakeUpTime; }
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<std::coroutine_handle<>> _ready;
+    std::priority_queue<SleepingCoroutine, std::vector<SleepingCoroutine>, std::greater<>> _sleeping;
+    size_t _unfinishedCount = 0;
+
+    void ProcessUntilFinished() {
+        std::unique_lock lock(_mutex);
+        while (_unfinishedCount > 0) {
+            const auto now = Clock::now();
+            while (!_sleeping.empty() && _sleeping.top().wakeUpTime <= now) {
+                _ready.push_back(_sleeping.top().handle);
+                _sleeping.pop();
+            }
+
+            if (!_ready.empty()) {
+                const auto handle = _ready.front();
+                _ready.pop_front();
+                lock.unlock();
+                handle.resume();
+                lock.lock();
+            } else if (!_sleeping.empty()) {
+                _condition.wait_until(lock, _sleeping.top().wakeUpTime);
+            } else {
+                _condition.wait(lock);
+            }
+        }
+    }
+  public:
+    void Start(Task& task) {
+        auto& promise = task.GetHandle().promise();
+        promise.loop = this;
+        promise.start = Clock::now();
+        {
+            std::lock_guard lock(_mutex);
+            ++_unfinishedCount;
+        }
+        Post(task.GetHandle());
+    }
+
+    // Thread safe, may be called from I/O completion callbacks
+    void Post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard lock(_mutex);
+            _ready.push_back(handle);
+        }
+        _condition.notify_one();
+    }
+
+    void PostAt(Clock::time_point wakeUpTime, std::coroutine_handle<> handle) {
+        {
+            std::lock_guard lock(_mutex);
+            _sleeping.push({wakeUpTime, handle});
+        }
+        _condition.notify_one();
+    }
+
+    void Finish() {
+        {
+            std::lock_guard lock(_mutex);
+            --_unfinishedCount;
+        }
+        _condition.notify_all();
+    }
+
+    void Run(size_t threadsCount) {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threadsCount; ++i)
+            workers.emplace_back([this] { ProcessUntilFinished(); });
+        ProcessUntilFinished();
+        for (auto& worker : workers)
+            worker.join();
+    }
+};
+
+std::coroutine_handle<> Task::FinalAwaiter::await_suspend(Handle handle) noexcept {
+    auto& promise = handle.promise();
+    if (promise.continuation)
+        return promise.continuation;
+
+    promise.finish = std::chrono::high_resolution_clock::now();
+    promise.loop->Finish();
+    return std::noop_coroutine();
+}
+
+void Sleep::await_suspend(Task::Handle handle) const {
+    handle.promise().loop->PostAt(std::chrono::high_resolution_clock::now() + _duration, handle);
+}
+
+void Yield::await_suspend(Task::Handle handle) const {
+    handle.promise().loop->Post(handle);
+}
+
+static char eventSetMarker;
+
+void Event::Set() {
+    const auto state = _state.exchange(&eventSetMarker, std::memory_order_acq_rel);
+    // The waiter may destroy this Event as soon as it is posted
+    if (state && state != &eventSetMarker)
+        _loop->Post(std::coroutine_handle<>::from_address(state));
+}
+
+bool Event::await_ready() const {
+    return _state.load(std::memory_order_acquire) == &eventSetMarker;
+}
+
+bool Event::await_suspend(Task::Handle handle) {
+    _loop = handle.promise().loop;
+    void* expected = nullptr;
+    return _state.compare_exchange_strong(expected, handle.address(), std::memory_order_acq_rel);
+}
+
+std::vector<CoroutineOutcome> RunCoroutines(const std::vector<Task (*)()>& coroutines, size_t threadsCount) {
+    EventLoop loop;
+    std::vector<Task> tasks;
+    tasks.reserve(coroutines.size());
+    for (const auto coroutine : coroutines)
+        tasks.push_back(coroutine());
+
+    for (auto& task : tasks)
+        loop.Start(task);
+    loop.Run(std::max<size_t>(1, threadsCount));
+
+    std::vector<CoroutineOutcome> outcomes;
+    for (const auto& task : tasks) {
+        const auto& promise = task.GetHandle().promise();
+        const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(promise.finish - promise.start);
+        outcomes.push_back({(uint64_t)time.count(), promise.exception});
+    }
+    return outcomes;
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+void RunStress(void (*function)(), size_t threadsCount) {
+    RunOnThreads(std::max<size_t>(threadsCount, 1), [function](size_t) { function(); });
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+// HDR-style histogram: values below 2^SubBucketBits are exact, above that every power of two
+// is split into 2^SubBucketBits linear buckets, which keeps the relative error under ~3%.
+class LatencyHistogram {
+  private:
+    static constexpr uint64_t SubBucketBits = 5;
+    static constexpr uint64_t SubBucketsCount = 1 << SubBucketBits;
+    static constexpr size_t BucketsCount = SubBucketsCount + (64 - SubBucketBits) * SubBucketsCount;
+
+    std::array<uint64_t, BucketsCount> _counts = {};
+    uint64_t _totalCount = 0;
+
+    static size_t GetIndex(uint64_t value) {
+        if (value < SubBucketsCount)
+            return value;
+        const uint64_t exponent = std::bit_width(value) - 1;
+        const uint64_t shift = exponent - SubBucketBits;
+        return SubBucketsCount + shift * SubBucketsCount + ((value >> shift) - SubBucketsCount);
+    }
+
+    static uint64_t GetHighestValue(size_t index) {
+        if (index < SubBucketsCount)
+            return index;
+        const uint64_t shift = (index - SubBucketsCount) / SubBucketsCount;
+        const uint64_t subBucket = (index - SubBucketsCount) % SubBucketsCount;
+        return ((SubBucketsCount + subBucket) << shift) + ((uint64_t)1 << shift) - 1;
+    }
+  public:
+    void Add(uint64_t value) {
+        ++_counts[GetIndex(value)];
+        ++_totalCount;
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BucketsCount; ++i)
+            _counts[i] += other._counts[i];
+        _totalCount += other._totalCount;
+    }
+
+    uint64_t GetTotalCount() const {
+        return _totalCount;
+    }
+
+    // percentile in [0, 1]
+    uint64_t GetValueAtPercentile(double percentile) const {
+        const auto target = std::max<uint64_t>(1, (uint64_t)std::ceil(percentile * _totalCount));
+        uint64_t count = 0;
+        for (size_t i = 0; i < BucketsCount; ++i) {
+            count += _counts[i];
+            if (count >= target)
+                return GetHighestValue(i);
+        }
+        return 0;
+    }
+};
+
+// Cores the process may run on. Linux reads the affinity mask, so pinning stays inside a restricted cpuset.
+static std::vector<size_t> GetAllowedCores() {
+    std::vector<size_t> cores;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (size_t core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &set))
+                cores.push_back(core);
+        }
+    }
+#endif
+    if (cores.empty()) {
+        cores.resize(std::max(1u, std::thread::hardware_concurrency()));
+        std::iota(cores.begin(), cores.end(), 0);
+    }
+    return cores;
+}
+
+// Linux pins hard, macOS only accepts an affinity hint. Returns false if the thread is not pinned.
+static bool PinCurrentThreadToCore(size_t core) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(__APPLE__)
+    thread_affinity_policy_data_t policy = { (integer_t)(core + 1) };
+    return thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+                             (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT) == KERN_SUCCESS;
+#else
+    (void)core;
+    return false;
+#endif
+}
+
+// Median cost of an empty Restart() / GetNanoseconds() pair, subtracted from every latency sample
+static uint64_t GetTimerOverhead() {
+    static const uint64_t overhead = [] {
+        std::array<uint64_t, 1001> samples;
+        Timer timer;
+        for (auto& sample : samples) {
+            timer.Restart();
+            sample = timer.GetNanoseconds();
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }();
+    return overhead;
+}
+
+static std::vector<size_t> GetBenchmarkThreadsCounts(size_t maxThreadsCount) {
+    const auto& threadsCounts = TestContext::GetOptions().benchmarkThreads;
+    if (!threadsCounts.empty())
+        return threadsCounts;
+
+    maxThreadsCount = std::max<size_t>(maxThreadsCount, 1);
+
+    std::vector<size_t> counts;
+    for (size_t count = 1; count < maxThreadsCount; count *= 2)
+        counts.push_back(count);
+    counts.push_back(maxThreadsCount);
+    return counts;
+}
+
+void RunThroughputBenchmark(void (*operation)(), size_t maxThreadsCount) {
+    const auto operationsCount = TestContext::GetOptions().benchmarkOperations;
+    const auto cores = GetAllowedCores();
+    const auto timerOverhead = GetTimerOverhead();
+    std::atomic<bool> isPinningFailed = false;
+    double singleThreadThroughput = 0;
+
+    for (const auto threadsCount : GetBenchmarkThreadsCounts(maxThreadsCount)) {
+        std::vector<LatencyHistogram> histograms(threadsCount);
+        std::vector<time_point<high_resolution_clock>> starts(threadsCount);
+        std::vector<time_point<high_resolution_clock>> finishes(threadsCount);
+
+        // Throughput is timed over the whole untimed batch, latencies in a second pass, so clock reads
+        // don't count as work. The passes are separate runs: a failure in the first one is rethrown
+        // after all its threads joined, and the latency pass is skipped.
+        RunOnThreads(threadsCount, [&](size_t threadIndex) {
+            if (!PinCurrentThreadToCore(cores[threadIndex % cores.size()]))
+                isPinningFailed = true;
+
+            starts[threadIndex] = high_resolution_clock::now();
+            for (uint64_t i = 0; i < operationsCount; ++i)
+                operation();
+            finishes[threadIndex] = high_resolution_clock::now();
+        });
+
+        RunOnThreads(threadsCount, [&](size_t threadIndex) {
+            if (!PinCurrentThreadToCore(cores[threadIndex % cores.size()]))
+                isPinningFailed = true;
+
+            auto& histogram = histograms[threadIndex];
+            Timer timer;
+            for (uint64_t i = 0; i < operationsCount; ++i) {
+                timer.Restart();
+                operation();
+                const auto latency = timer.GetNanoseconds();
+                histogram.Add(latency > timerOverhead ? latency - timerOverhead : 0);
+            }
+        });
+
+        LatencyHistogram merged;
+        for (const auto& histogram : histograms)
+            merged.Merge(histogram);
+
+        const auto start = *std::min_element(starts.begin(), starts.end());
+        const auto finish = *std::max_element(finishes.begin(), finishes.end());
+        const auto seconds = std::max<double>(1, duration_cast<nanoseconds>(finish - start).count()) / 1e9;
+        const double throughput = operationsCount * threadsCount / seconds;
+        if (singleThreadThroughput == 0)
+            singleThreadThroughput = throughput / threadsCount;
+        const double efficiency = throughput / (singleThreadThroughput * threadsCount);
+
+        std::stringstream ss;
+        ss << std::setw(3) << threadsCount << " thread(s): "
+        << std::setw(12) << (uint64_t)throughput << " ops/s, efficiency "
+        << std::setw(3) << (int)std::round(efficiency * 100) << "%, p50 "
+        << merged.GetValueAtPercentile(0.5) << "ns, p99 "
+        << merged.GetValueAtPercentile(0.99) << "ns, p999 "
+        << merged.GetValueAtPercentile(0.999) << "ns";
+        TestContext::AddDetail(ss.str());
+    }
+
+    if (isPinningFailed)
+        TestContext::AddDetail("threads could not be pinned to cores, results may vary between runs");
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+const char* ToString(Complexity complexity) {
+    switch (complexity) {
+        case Complexity::O1: return "O(1)";
+        case Complexity::OLogN: return "O(log n)";
+        case Complexity::ON: return "O(n)";
+        case Complexity::ONLogN: return "O(n log n)";
+        case Complexity::ON2: return "O(n^2)";
+    }
+    return "";
+}
+
+double GetComplexityFactor(Complexity complexity, double n) {
+    switch (complexity) {
+        case Complexity::O1: return 1;
+        case Complexity::OLogN: return std::log2(n);
+        case Complexity::ON: return n;
+        case Complexity::ONLogN: return n * std::log2(n);
+        case Complexity::ON2: return n * n;
+    }
+    return 1;
+}
+
+ComplexityFit FitComplexity(const std::vector<size_t>& sizes, const std::vector<double>& times, Complexity declared) {
+    constexpr double MaxDeclaredError = 0.15;
+    constexpr double DeclaredErrorMargin = 0.05;
+    const Complexity complexities[] = { Complexity::O1, Complexity::OLogN, Complexity::ON, Complexity::ONLogN, Complexity::ON2 };
+
+    std::vector<ComplexityFit> fits;
+    for (const auto complexity : complexities) {
+        double factorByTime = 0;
+        double factorByTimeSquared = 0;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            const auto ratio = GetComplexityFactor(complexity, (double)sizes[i]) / times[i];
+            factorByTime += ratio;
+            factorByTimeSquared += ratio * ratio;
+        }
+
+        ComplexityFit fit;
+        fit.complexity = complexity;
+        fit.coefficient = factorByTime / factorByTimeSquared;
+        double squaredError = 0;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            const auto predicted = fit.coefficient * GetComplexityFactor(complexity, (double)sizes[i]);
+            const auto residual = (times[i] - predicted) / times[i];
+            squaredError += residual * residual;
+        }
+        fit.relativeError = std::sqrt(squaredError / sizes.size());
+        fits.push_back(fit);
+    }
+
+    auto best = fits.front();
+    for (const auto& fit : fits) {
+        if (fit.relativeError < best.relativeError)
+            best = fit;
+    }
+    const auto& declaredFit = fits[(size_t)declared];
+    if (declaredFit.relativeError <= MaxDeclaredError && declaredFit.relativeError <= best.relativeError + DeclaredErrorMargin)
+        return declaredFit;
+    return best;
+}
+
+thread_local Timer* ComplexityTimer::_timer = nullptr;
+
+void ComplexityTimer::Restart() {
+    if (_timer)
+        _timer->Restart();
+}
+
+// Each size is measured several times and the median run is kept to filter out scheduling noise. Unlike the fastest
+// run it doesn't drift down with the runs count, which is larger for the small sizes and would bend the curve upwards.
+static double MeasureComplexityPoint(void (*function)(size_t), size_t n) {
+    constexpr uint64_t MinRunsCount = 3;
+    constexpr uint64_t MaxRunsCount = 1000;
+    constexpr uint64_t MinTotalNanoseconds = 10000000;
+
+    Timer timer;
+    ComplexityTimer::Scope scope(timer);
+    std::vector<uint64_t> times;
+    uint64_t total = 0;
+    while (times.size() < MaxRunsCount && (times.size() < MinRunsCount || total < MinTotalNanoseconds)) {
+        timer.Restart();
+        function(n);
+        times.push_back(timer.GetNanoseconds());
+        total += times.back();
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return (double)times[times.size() / 2];
+}
+
+void CheckComplexity(void (*function)(size_t), Complexity declared, const std::vector<size_t>& sizes, uint64_t line) {
+    // Fewer points can't tell the classes apart, and log2(0) isn't a factor
+    constexpr size_t MinDistinctSizesCount = 3;
+    auto distinctSizes = sizes;
+    std::sort(distinctSizes.begin(), distinctSizes.end());
+    distinctSizes.erase(std::unique(distinctSizes.begin(), distinctSizes.end()), distinctSizes.end());
+    if (distinctSizes.size() < MinDistinctSizesCount || distinctSizes.front() == 0)
+        throw Error(line, ToString(declared), "Needs at least 3 distinct positive sizes");
+
+    std::vector<double> times;
+    for (const auto n : sizes) {
+        times.push_back(std::max(1.0, MeasureComplexityPoint(function, n)));
+
+        std::stringstream ss;
+        ss << "n = " << n << ": " << times.back() / 1e6 << "ms";
+        TestContext::AddDetail(ss.str());
+    }
+
+    const auto fit = FitComplexity(sizes, times, declared);
+    std::stringstream ss;
+    ss << "fit " << ToString(fit.complexity) << ", coefficient " << fit.coefficient << "ns, RMS "
+    << (int)std::round(fit.relativeError * 100) << "%";
+    TestContext::AddDetail(ss.str());
+
+    if (fit.complexity > declared)
+        throw Error(line, ToString(declared), std::string("Fitted ") + ToString(fit.complexity) + " is worse than declared");
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+namespace
+{
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    uint64_t start;
+    uint64_t end;
+    uint64_t asyncId;
+    bool isAsync;
+};
+
+// Written only by its own thread, read only when the program exits
+struct TraceBuffer {
+    uint64_t threadId;
+    std::vector<TraceEvent> events;
+};
+
+class TraceSession {
+  private:
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> _buffers;
+
+    static void WriteEscaped(std::ofstream& file, const char* text) {
+        for (; *text; ++text) {
+            if (*text == '"' || *text == '\\')
+                file << '\\';
+            if ((unsigned char)*text >= 0x20)
+                file << *text;
+        }
+    }
+
+    static void WriteEvent(std::ofstream& file, const TraceEvent& event, uint64_t threadId, const char* phase, uint64_t timestamp) {
+        file << ",\n{\"name\":\"";
+        WriteEscaped(file, event.name);
+        file << "\",\"cat\":\"" << event.category << "\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << threadId
+        << ",\"ts\":" << (double)timestamp / 1e3;
+        if (event.isAsync)
+            file << ",\"id\":" << event.asyncId;
+        else
+            file << ",\"dur\":" << (double)(event.end - event.start) / 1e3;
+        file << '}';
+    }
+  public:
+    Timer epoch;
+    std::string path;
+
+    TraceBuffer& GetThreadBuffer() {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (!buffer) {
+            MemoryAllocator::UntrackedScope untracked;
+            std::lock_guard lock(_mutex);
+            _buffers.push_back(std::make_unique<TraceBuffer>());
+            buffer = _buffers.back().get();
+            buffer->threadId = _buffers.size();
+        }
+        return *buffer;
+    }
+
+    ~TraceSession() {
+        if (path.empty())
+            return;
+
+        std::ofstream file(path);
+        // Microseconds with nanosecond digits, the default 6 significant digits lose resolution after a second
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"UnitTestSystem\"}}";
+        for (const auto& buffer : _buffers) {
+            file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+            << ",\"args\":{\"name\":\"" << (buffer->threadId == 1 ? "runner" : "worker ");
+            if (buffer->threadId != 1)
+                file << buffer->threadId - 1;
+            file << "\"}}";
+
+            for (const auto& event : buffer->events) {
+                if (event.isAsync) {
+                    WriteEvent(file, event, buffer->threadId, "b", event.start);
+                    WriteEvent(file, event, buffer->threadId, "e", event.end);
+                } else {
+                    WriteEvent(file, event, buffer->threadId, "X", event.start);
+                }
+            }
+        }
+        file << "\n]}\n";
+    }
+};
+
+TraceSession& GetTraceSession() {
+    static TraceSession session;
+    return session;
+}
+
+void AddTraceEvent(const TraceEvent& event) {
+    auto& buffer = GetTraceSession().GetThreadBuffer();
+    MemoryAllocator::UntrackedScope untracked;
+    buffer.events.push_back(event);
+}
+
+} // namespace
+
+bool Trace::_isEnabled = false;
+
+void Trace::Enable(const std::string& path) {
+    if (_isEnabled)
+        return;
+    MemoryAllocator::UntrackedScope untracked;
+    auto& session = GetTraceSession();
+    session.path = path;
+    session.GetThreadBuffer();
+    _isEnabled = true;
+}
+
+uint64_t Trace::GetTimestamp() {
+    return GetTraceSession().epoch.GetNanoseconds();
+}
+
+void Trace::AddEvent(const char* name, const char* category, uint64_t start, uint64_t end) {
+    AddTraceEvent({name, category, start, end, 0, false});
+}
+
+void Trace::AddAsyncEvent(const char* name, const char* category, uint64_t start, uint64_t end) {
+    static std::atomic<uint64_t> lastId = 0;
+    AddTraceEvent({name, category, start, end, ++lastId, true});
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+namespace
+{
+
+uint64_t ToNanoseconds(const timeval& time) {
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_usec * 1000;
+}
+
+uint64_t GetDifference(uint64_t end, uint64_t start) {
+    return end > start ? end - start : 0;
+}
+
+ResourceUsage GetProcessUsage() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    ResourceUsage result;
+    result.userNanoseconds = ToNanoseconds(usage.ru_utime);
+    result.systemNanoseconds = ToNanoseconds(usage.ru_stime);
+#if defined(__APPLE__)
+    result.peakResidentBytes = (uint64_t)usage.ru_maxrss;
+#else
+    result.peakResidentBytes = (uint64_t)usage.ru_maxrss * 1024;
+#endif
+    result.minorFaults = (uint64_t)usage.ru_minflt;
+    result.majorFaults = (uint64_t)usage.ru_majflt;
+    result.voluntarySwitches = (uint64_t)usage.ru_nvcsw;
+    result.involuntarySwitches = (uint64_t)usage.ru_nivcsw;
+    return result;
+}
+
+#if defined(__linux__)
+// Reads a "VmHWM:    1234 kB" line of /proc/self/status
+uint64_t ReadStatusBytes(const std::string& name) {
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, name.length(), name) == 0)
+            return std::stoull(line.substr(name.length())) * 1024;
+    }
+    return 0;
+}
+
+// Restarts VmHWM from the current RSS, so the next peak belongs to the running test
+bool ResetPeakResident() {
+    std::ofstream file("/proc/self/clear_refs");
+    file << "5";
+    file.close();
+    return !file.fail();
+}
+#endif
+
+} // namespace
+
+void ResourceUsage::Add(const ResourceUsage& other) {
+    userNanoseconds += other.userNanoseconds;
+    systemNanoseconds += other.systemNanoseconds;
+    peakResidentBytes = std::max(peakResidentBytes, other.peakResidentBytes);
+    minorFaults += other.minorFaults;
+    majorFaults += other.majorFaults;
+    voluntarySwitches += other.voluntarySwitches;
+    involuntarySwitches += other.involuntarySwitches;
+}
+
+std::string ResourceUsage::ToString() const {
+    std::stringstream ss;
+    ss << "cpu " << (double)userNanoseconds / 1e6 << "ms user + " << (double)systemNanoseconds / 1e6 << "ms sys"
+    << ", peak RSS +" << peakResidentBytes / 1024 << "KiB"
+    << ", page faults " << minorFaults << " minor / " << majorFaults << " major"
+    << ", context switches " << voluntarySwitches << " voluntary / " << involuntarySwitches << " involuntary";
+    return ss.str();
+}
+
+std::string ResourceLimits::GetViolation(const ResourceUsage& usage) const {
+    std::stringstream ss;
+    if (maxPeakResidentBytes > 0 && usage.peakResidentBytes > maxPeakResidentBytes)
+        ss << "Peak RSS +" << usage.peakResidentBytes / 1024 << "KiB is over the limit of " << maxPeakResidentBytes / 1024 << "KiB";
+    else if (maxCpuNanoseconds > 0 && usage.GetCpuNanoseconds() > maxCpuNanoseconds)
+        ss << "CPU time " << (double)usage.GetCpuNanoseconds() / 1e6 << "ms is over the limit of " << (double)maxCpuNanoseconds / 1e6 << "ms";
+    return ss.str();
+}
+
+// Without procfs the peak comes from ru_maxrss, which only grows when the test beats the peak of the whole process
+void ResourceMeter::Start() {
+    MemoryAllocator::UntrackedScope untracked;
+#if defined(__linux__)
+    _isPeakReset = ResetPeakResident();
+    if (_isPeakReset)
+        _startResidentBytes = ReadStatusBytes("VmRSS:");
+#endif
+    _start = GetProcessUsage();
+}
+
+ResourceUsage ResourceMeter::Stop() const {
+    MemoryAllocator::UntrackedScope untracked;
+    const auto end = GetProcessUsage();
+
+    ResourceUsage usage;
+    usage.userNanoseconds = GetDifference(end.userNanoseconds, _start.userNanoseconds);
+    usage.systemNanoseconds = GetDifference(end.systemNanoseconds, _start.systemNanoseconds);
+    usage.peakResidentBytes = GetDifference(end.peakResidentBytes, _start.peakResidentBytes);
+#if defined(__linux__)
+    if (_isPeakReset)
+        usage.peakResidentBytes = GetDifference(ReadStatusBytes("VmHWM:"), _startResidentBytes);
+#endif
+    usage.minorFaults = GetDifference(end.minorFaults, _start.minorFaults);
+    usage.majorFaults = GetDifference(end.majorFaults, _start.majorFaults);
+    usage.voluntarySwitches = GetDifference(end.voluntarySwitches, _start.voluntarySwitches);
+    usage.involuntarySwitches = GetDifference(end.involuntarySwitches, _start.involuntarySwitches);
+    return usage;
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+namespace
+{
+
+constexpr size_t ChunkSize = 1 << 20;
+constexpr size_t BytesPerRow = 16;
+
+// Read-only mapping of a whole regular file, an empty file is valid but not mapped
+class MappedFile {
+  private:
+    int _file = -1;
+    const unsigned char* _data = nullptr;
+    size_t _size = 0;
+    std::string _problem;
+  public:
+    explicit MappedFile(const std::string& path) {
+        _file = open(path.c_str(), O_RDONLY);
+        if (_file < 0) {
+            _problem = (errno == ENOENT) ? "is missing, run with --update-snapshots to create it"
+                                         : std::string("can't be opened: ") + strerror(errno);
+            return;
+        }
+
+        struct stat status;
+        if (fstat(_file, &status) != 0 || !S_ISREG(status.st_mode)) {
+            _problem = "is not a regular file";
+            return;
+        }
+        if (status.st_size == 0)
+            return;
+
+        auto data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, _file, 0);
+        if (data == MAP_FAILED) {
+            _problem = std::string("can't be mapped: ") + strerror(errno);
+            return;
+        }
+        madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+        _data = (const unsigned char*)data;
+        _size = (size_t)status.st_size;
+    }
+
+    ~MappedFile() {
+        if (_data)
+            munmap((void*)_data, _size);
+        if (_file >= 0)
+            close(_file);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Empty if the file can be compared
+    const std::string& GetProblem() const { return _problem; }
+    const unsigned char* GetData() const { return _data; }
+    size_t GetSize() const { return _size; }
+};
+
+// Offset of the first differing byte, or of the end of the shorter buffer if one is a prefix of the other.
+// memcmp skips equal chunks with the library's vectorized loop, only the differing chunk is scanned bytewise.
+size_t FindFirstDifference(const unsigned char* a, size_t aSize, const unsigned char* b, size_t bSize) {
+    const auto size = std::min(aSize, bSize);
+    size_t offset = 0;
+    while (offset < size) {
+        const auto chunk = std::min(ChunkSize, size - offset);
+        if (memcmp(a + offset, b + offset, chunk) != 0)
+            return offset + (size_t)(std::mismatch(a + offset, a + offset + chunk, b + offset).first - a - offset);
+        offset += chunk;
+    }
+    return size;
+}
+
+// "actual   00000010  68 65 6c 6c 6f 20 20 20 ...  hello..."
+std::string GetRow(const char* label, const unsigned char* data, size_t size, size_t rowOffset) {
+    std::stringstream ss;
+    ss << label << std::hex << std::setfill('0') << std::setw(8) << rowOffset << "  ";
+    for (size_t i = rowOffset; i < rowOffset + BytesPerRow; ++i) {
+        if (i < size)
+            ss << std::setw(2) << (unsigned)data[i] << ' ';
+        else
+            ss << "   ";
+    }
+    ss << ' ';
+    for (size_t i = rowOffset; i < std::min(rowOffset + BytesPerRow, size); ++i)
+        ss << (char)((data[i] >= 0x20 && data[i] < 0x7f) ? data[i] : '.');
+    return ss.str();
+}
+
+// Two rows around the difference for each side, with a marker under the first differing byte
+void AddDifferenceWindow(const unsigned char* actual, size_t actualSize,
+                         const unsigned char* snapshot, size_t snapshotSize, size_t offset) {
+    const auto rowOffset = offset / BytesPerRow * BytesPerRow;
+    const auto firstRow = rowOffset >= BytesPerRow ? rowOffset - BytesPerRow : 0;
+    for (auto row = firstRow; row <= rowOffset; row += BytesPerRow) {
+        TestContext::AddDetail(GetRow("actual   ", actual, actualSize, row));
+        TestContext::AddDetail(GetRow("snapshot ", snapshot, snapshotSize, row));
+    }
+    TestContext::AddDetail(std::string(19 + (offset - rowOffset) * 3, ' ') + "^^");
+}
+
+void UpdateSnapshot(const void* data, size_t size, const std::string& path, uint64_t line, const std::string& code) {
+    const auto temporaryPath = path + ".tmp" + std::to_string(getpid());
+    auto file = fopen(temporaryPath.c_str(), "wb");
+    bool isWritten = file && fwrite(data, 1, size, file) == size;
+    // The data must be on disk before the rename, or a crash can leave a truncated golden file
+    isWritten = isWritten && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (file)
+        isWritten &= fclose(file) == 0;
+
+    if (!isWritten || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        remove(temporaryPath.c_str());
+        throw Error(line, code, "Can't update snapshot " + path);
+    }
+}
+
+} // namespace
+
+void MustMatchSnapshot(const void* data, size_t size, const std::string& path, uint64_t line, const std::string& code) {
+    if (TestContext::GetOptions().updateSnapshots) {
+        UpdateSnapshot(data, size, path, line, code);
+        return;
+    }
+
+    const MappedFile snapshot(path);
+    if (!snapshot.GetProblem().empty())
+        throw Error(line, code, "Snapshot " + path + " " + snapshot.GetProblem());
+
+    const auto actual = (const unsigned char*)data;
+    const auto offset = FindFirstDifference(actual, size, snapshot.GetData(), snapshot.GetSize());
+    if (offset == size && offset == snapshot.GetSize())
+        return;
+
+    AddDifferenceWindow(actual, size, snapshot.GetData(), snapshot.GetSize(), offset);
+    throw Error(line, code, "Differs from " + path + " at offset " + std::to_string(offset)
+                + " (" + std::to_string(size) + " vs " + std::to_string(snapshot.GetSize()) + " bytes)");
+}
+
+} // namespace UnitTestSystem
+
+namespace UnitTestSystem
+{
+
+PropertyCases RunPropertyCases(const char* name, bool (*runCase)(const void* context, uint64_t seed), const void* context) {
+    const auto& options = TestContext::GetOptions();
+    PropertyCases cases;
+    if (options.propertySeedTest == name) {
+        cases.count = 1;
+        cases.isFailed = !runCase(context, options.propertySeed);
+        cases.failedSeed = options.propertySeed;
+        return cases;
+    }
+
+    const auto threadsCount = options.propertyThreads > 0 ? options.propertyThreads
+                                                          : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const auto maxNanoseconds = options.propertyMilliseconds * 1000000;
+    const Timer timer;
+
+    std::atomic<uint64_t> nextCase = 0;
+    std::atomic<uint64_t> casesCount = 0;
+    std::atomic<uint64_t> failedCase = UINT64_MAX;
+
+    // Cases are handed out by index, so the first failing index is the same however the threads interleave,
+    // as long as the budget doesn't run out first
+    RunOnThreads(threadsCount, [&](size_t) {
+        for (;;) {
+            const auto index = nextCase++;
+            if (index >= options.propertyCases || index > failedCase)
+                break;
+            if (maxNanoseconds > 0 && timer.GetNanoseconds() > maxNanoseconds)
+                break;
+
+            ++casesCount;
+            if (!runCase(context, PropertyRandom(options.seed + index).Next())) {
+                auto failed = failedCase.load();
+                while (index < failed && !failedCase.compare_exchange_weak(failed, index)) {}
+            }
+        }
+    });
+
+    cases.count = casesCount;
+    cases.isFailed = failedCase != UINT64_MAX;
+    if (cases.isFailed)
+        cases.failedSeed = PropertyRandom(options.seed + failedCase).Next();
+
+    TestContext::AddDetail(std::to_string(cases.count) + " case(s) on " + std::to_string(threadsCount) + " thread(s)");
+    return cases;
+}
+
+} // namespace UnitTestSystem
@@ -0,0 +1,211 @@
+#include "Benchmark.h"
+#include "Timer.h"
+#include "Threads.h"
+#include "TestClassBase.h"
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#endif
+
+namespace UnitTestSystem
+{
+
+// HDR-style histogram: values below 2^SubBucketBits are exact, above that every power of two
+// is split into 2^SubBucketBits linear buckets, which keeps the relative error under ~3%.
+class LatencyHistogram {
+  private:
+    static constexpr uint64_t SubBucketBits = 5;
+    static constexpr uint64_t SubBucketsCount = 1 << SubBucketBits;
+    static constexpr size_t BucketsCount = SubBucketsCount + (64 - SubBucketBits) * SubBucketsCount;
+
+    std::array<uint64_t, BucketsCount> _counts = {};
+    uint64_t _totalCount = 0;
+
+    static size_t GetIndex(uint64_t value) {
+        if (value < SubBucketsCount)
+            return value;
+        const uint64_t exponent = std::bit_width(value) - 1;
+        const uint64_t shift = exponent - SubBucketBits;
+        return SubBucketsCount + shift * SubBucketsCount + ((value >> shift) - SubBucketsCount);
+    }
+
+    static uint64_t GetHighestValue(size_t index) {
+        if (index < SubBucketsCount)
+            return index;
+        const uint64_t shift = (index - SubBucketsCount) / SubBucketsCount;
+        const uint64_t subBucket = (index - SubBucketsCount) % SubBucketsCount;
+        return ((SubBucketsCount + subBucket) << shift) + ((uint64_t)1 << shift) - 1;
+    }
+  public:
+    void Add(uint64_t value) {
+        ++_counts[GetIndex(value)];
+        ++_totalCount;
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BucketsCount; ++i)
+            _counts[i] += other._counts[i];
+        _totalCount += other._totalCount;
+    }
+
+    uint64_t GetTotalCount() const {
+        return _totalCount;
+    }
+
+    // percentile in [0, 1]
+    uint64_t GetValueAtPercentile(double percentile) const {
+        const auto target = std::max<uint64_t>(1, (uint64_t)std::ceil(percentile * _totalCount));
+        uint64_t count = 0;
+        for (size_t i = 0; i < BucketsCount; ++i) {
+            count += _counts[i];
+            if (count >= target)
+                return GetHighestValue(i);
+        }
+        return 0;
+    }
+};
+
+// Cores the process may run on. Linux reads the affinity mask, so pinning stays inside a restricted cpuset.
+static std::vector<size_t> GetAllowedCores() {
+    std::vector<size_t> cores;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (size_t core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &set))
+                cores.push_back(core);
+        }
+    }
+#endif
+    if (cores.empty()) {
+        cores.resize(std::max(1u, std::thread::hardware_concurrency()));
+        std::iota(cores.begin(), cores.end(), 0);
+    }
+    return cores;
+}
+
+// Linux pins hard, macOS only accepts an affinity hint. Returns false if the thread is not pinned.
+static bool PinCurrentThreadToCore(size_t core) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(__APPLE__)
+    thread_affinity_policy_data_t policy = { (integer_t)(core + 1) };
+    return thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+                             (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT) == KERN_SUCCESS;
+#else
+    (void)core;
+    return false;
+#endif
+}
+
+// Median cost of an empty Restart() / GetNanoseconds() pair, subtracted from every latency sample
+static uint64_t GetTimerOverhead() {
+    static const uint64_t overhead = [] {
+        std::array<uint64_t, 1001> samples;
+        Timer timer;
+        for (auto& sample : samples) {
+            timer.Restart();
+            sample = timer.GetNanoseconds();
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }();
+    return overhead;
+}
+
+static std::vector<size_t> GetBenchmarkThreadsCounts(size_t maxThreadsCount) {
+    const auto& threadsCounts = TestContext::GetOptions().benchmarkThreads;
+    if (!threadsCounts.empty())
+        return threadsCounts;
+
+    maxThreadsCount = std::max<size_t>(maxThreadsCount, 1);
+
+    std::vector<size_t> counts;
+    for (size_t count = 1; count < maxThreadsCount; count *= 2)
+        counts.push_back(count);
+    counts.push_back(maxThreadsCount);
+    return counts;
+}
+
+void RunThroughputBenchmark(void (*operation)(), size_t maxThreadsCount) {
+    const auto operationsCount = TestContext::GetOptions().benchmarkOperations;
+    const auto cores = GetAllowedCores();
+    const auto timerOverhead = GetTimerOverhead();
+    std::atomic<bool> isPinningFailed = false;
+    double singleThreadThroughput = 0;
+
+    for (const auto threadsCount : GetBenchmarkThreadsCounts(maxThreadsCount)) {
+        std::vector<LatencyHistogram> histograms(threadsCount);
+        std::vector<time_point<high_resolution_clock>> starts(threadsCount);
+        std::vector<time_point<high_resolution_clock>> finishes(threadsCount);
+
+        // Throughput is timed over the whole untimed batch, latencies in a second pass, so clock reads
+        // don't count as work. The passes are separate runs: a failure in the first one is rethrown
+        // after all its threads joined, and the latency pass is skipped.
+        RunOnThreads(threadsCount, [&](size_t threadIndex) {
+            if (!PinCurrentThreadToCore(cores[threadIndex % cores.size()]))
+                isPinningFailed = true;
+
+            starts[threadIndex] = high_resolution_clock::now();
+            for (uint64_t i = 0; i < operationsCount; ++i)
+                operation();
+            finishes[threadIndex] = high_resolution_clock::now();
+        });
+
+        RunOnThreads(threadsCount, [&](size_t threadIndex) {
+            if (!PinCurrentThreadToCore(cores[threadIndex % cores.size()]))
+                isPinningFailed = true;
+
+            auto& histogram = histograms[threadIndex];
+            Timer timer;
+            for (uint64_t i = 0; i < operationsCount; ++i) {
+                timer.Restart();
+                operation();
+                const auto latency = timer.GetNanoseconds();
+                histogram.Add(latency > timerOverhead ? latency - timerOverhead : 0);
+            }
+        });
+
+        LatencyHistogram merged;
+        for (const auto& histogram : histograms)
+            merged.Merge(histogram);
+
+        const auto start = *std::min_element(starts.begin(), starts.end());
+        const auto finish = *std::max_element(finishes.begin(), finishes.end());
+        const auto seconds = std::max<double>(1, duration_cast<nanoseconds>(finish - start).count()) / 1e9;
+        const double throughput = operationsCount * threadsCount / seconds;
+        if (singleThreadThroughput == 0)
+            singleThreadThroughput = throughput / threadsCount;
+        const double efficiency = throughput / (singleThreadThroughput * threadsCount);
+
+        std::stringstream ss;
+        ss << std::setw(3) << threadsCount << " thread(s): "
+        << std::setw(12) << (uint64_t)throughput << " ops/s, efficiency "
+        << std::setw(3) << (int)std::round(efficiency * 100) << "%, p50 "
+        << merged.GetValueAtPercentile(0.5) << "ns, p99 "
+        << merged.GetValueAtPercentile(0.99) << "ns, p999 "
+        << merged.GetValueAtPercentile(0.999) << "ns";
+        TestContext::AddDetail(ss.str());
+    }
+
+    if (isPinningFailed)
+        TestContext::AddDetail("threads could not be pinned to cores, results may vary between runs");
+}
+
+} // namespace UnitTestSystem
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+
+namespace UnitTestSystem
+{
+
+// Runs the operation benchmarkOperations times on every thread for each thread count of the sweep
+// and reports throughput, scaling efficiency against the first thread count and merged latency percentiles.
+// Each thread runs its batch twice: untimed for throughput, then timing every operation for latencies.
+void RunThroughputBenchmark(void (*operation)(), size_t maxThreadsCount);
+
+} // namespace UnitTestSystem
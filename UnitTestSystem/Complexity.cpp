@@ -0,0 +1,128 @@
+#include "Complexity.h"
+#include "TestClassBase.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+namespace UnitTestSystem
+{
+
+const char* ToString(Complexity complexity) {
+    switch (complexity) {
+        case Complexity::O1: return "O(1)";
+        case Complexity::OLogN: return "O(log n)";
+        case Complexity::ON: return "O(n)";
+        case Complexity::ONLogN: return "O(n log n)";
+        case Complexity::ON2: return "O(n^2)";
+    }
+    return "";
+}
+
+double GetComplexityFactor(Complexity complexity, double n) {
+    switch (complexity) {
+        case Complexity::O1: return 1;
+        case Complexity::OLogN: return std::log2(n);
+        case Complexity::ON: return n;
+        case Complexity::ONLogN: return n * std::log2(n);
+        case Complexity::ON2: return n * n;
+    }
+    return 1;
+}
+
+ComplexityFit FitComplexity(const std::vector<size_t>& sizes, const std::vector<double>& times, Complexity declared) {
+    constexpr double MaxDeclaredError = 0.15;
+    constexpr double DeclaredErrorMargin = 0.05;
+    const Complexity complexities[] = { Complexity::O1, Complexity::OLogN, Complexity::ON, Complexity::ONLogN, Complexity::ON2 };
+
+    std::vector<ComplexityFit> fits;
+    for (const auto complexity : complexities) {
+        double factorByTime = 0;
+        double factorByTimeSquared = 0;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            const auto ratio = GetComplexityFactor(complexity, (double)sizes[i]) / times[i];
+            factorByTime += ratio;
+            factorByTimeSquared += ratio * ratio;
+        }
+
+        ComplexityFit fit;
+        fit.complexity = complexity;
+        fit.coefficient = factorByTime / factorByTimeSquared;
+        double squaredError = 0;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            const auto predicted = fit.coefficient * GetComplexityFactor(complexity, (double)sizes[i]);
+            const auto residual = (times[i] - predicted) / times[i];
+            squaredError += residual * residual;
+        }
+        fit.relativeError = std::sqrt(squaredError / sizes.size());
+        fits.push_back(fit);
+    }
+
+    auto best = fits.front();
+    for (const auto& fit : fits) {
+        if (fit.relativeError < best.relativeError)
+            best = fit;
+    }
+    const auto& declaredFit = fits[(size_t)declared];
+    if (declaredFit.relativeError <= MaxDeclaredError && declaredFit.relativeError <= best.relativeError + DeclaredErrorMargin)
+        return declaredFit;
+    return best;
+}
+
+thread_local Timer* ComplexityTimer::_timer = nullptr;
+
+void ComplexityTimer::Restart() {
+    if (_timer)
+        _timer->Restart();
+}
+
+// Each size is measured several times and the median run is kept to filter out scheduling noise. Unlike the fastest
+// run it doesn't drift down with the runs count, which is larger for the small sizes and would bend the curve upwards.
+static double MeasureComplexityPoint(void (*function)(size_t), size_t n) {
+    constexpr uint64_t MinRunsCount = 3;
+    constexpr uint64_t MaxRunsCount = 1000;
+    constexpr uint64_t MinTotalNanoseconds = 10000000;
+
+    Timer timer;
+    ComplexityTimer::Scope scope(timer);
+    std::vector<uint64_t> times;
+    uint64_t total = 0;
+    while (times.size() < MaxRunsCount && (times.size() < MinRunsCount || total < MinTotalNanoseconds)) {
+        timer.Restart();
+        function(n);
+        times.push_back(timer.GetNanoseconds());
+        total += times.back();
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return (double)times[times.size() / 2];
+}
+
+void CheckComplexity(void (*function)(size_t), Complexity declared, const std::vector<size_t>& sizes, uint64_t line) {
+    // Fewer points can't tell the classes apart, and log2(0) isn't a factor
+    constexpr size_t MinDistinctSizesCount = 3;
+    auto distinctSizes = sizes;
+    std::sort(distinctSizes.begin(), distinctSizes.end());
+    distinctSizes.erase(std::unique(distinctSizes.begin(), distinctSizes.end()), distinctSizes.end());
+    if (distinctSizes.size() < MinDistinctSizesCount || distinctSizes.front() == 0)
+        throw Error(line, ToString(declared), "Needs at least 3 distinct positive sizes");
+
+    std::vector<double> times;
+    for (const auto n : sizes) {
+        times.push_back(std::max(1.0, MeasureComplexityPoint(function, n)));
+
+        std::stringstream ss;
+        ss << "n = " << n << ": " << times.back() / 1e6 << "ms";
+        TestContext::AddDetail(ss.str());
+    }
+
+    const auto fit = FitComplexity(sizes, times, declared);
+    std::stringstream ss;
+    ss << "fit " << ToString(fit.complexity) << ", coefficient " << fit.coefficient << "ns, RMS "
+    << (int)std::round(fit.relativeError * 100) << "%";
+    TestContext::AddDetail(ss.str());
+
+    if (fit.complexity > declared)
+        throw Error(line, ToString(declared), std::string("Fitted ") + ToString(fit.complexity) + " is worse than declared");
+}
+
+} // namespace UnitTestSystem
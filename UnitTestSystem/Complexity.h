@@ -0,0 +1,45 @@
+#pragma once
+#include "Timer.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace UnitTestSystem
+{
+
+enum class Complexity { O1, OLogN, ON, ONLogN, ON2 };
+
+const char* ToString(Complexity complexity);
+double GetComplexityFactor(Complexity complexity, double n);
+
+struct ComplexityFit {
+    Complexity complexity = Complexity::O1;
+    double coefficient = 0;
+    double relativeError = 0; // RMS of residuals relative to the measured times
+};
+
+// Least squares fit of time = coefficient * f(n) for every class, on residuals relative to the measured time
+// so that small sizes count as much as large ones. The class with the smallest error wins, except that the declared
+// class is kept while its own error is small and close to the best, otherwise measurement noise would often "prove"
+// O(n log n) for O(n) code. No other class gets that benefit, so worse than declared code can't hide behind it.
+ComplexityFit FitComplexity(const std::vector<size_t>& sizes, const std::vector<double>& times, Complexity declared);
+
+// Lets a complexity benchmark exclude its setup: only the time after the last Restart() is measured
+class ComplexityTimer {
+  private:
+    static thread_local Timer* _timer;
+  public:
+    class Scope {
+      public:
+        Scope(Timer& timer) { _timer = &timer; }
+        ~Scope() { _timer = nullptr; }
+    };
+
+    static void Restart();
+};
+
+// Fails with Error at line when the measured times fit a worse class than the declared one,
+// or when there are fewer than 3 distinct positive sizes
+void CheckComplexity(void (*function)(size_t), Complexity declared, const std::vector<size_t>& sizes, uint64_t line);
+
+} // namespace UnitTestSystem
@@ -0,0 +1,155 @@
+#include "Coroutine.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace UnitTestSystem
+{
+
+// Resumes ready coroutines and expired sleeps on one or more threads until every started task finishes
+class EventLoop {
+  private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct SleepingCoroutine {
+        Clock::time_point wakeUpTime;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const SleepingCoroutine& other) const { return wakeUpTime > other.wakeUpTime; }
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<std::coroutine_handle<>> _ready;
+    std::priority_queue<SleepingCoroutine, std::vector<SleepingCoroutine>, std::greater<>> _sleeping;
+    size_t _unfinishedCount = 0;
+
+    void ProcessUntilFinished() {
+        std::unique_lock lock(_mutex);
+        while (_unfinishedCount > 0) {
+            const auto now = Clock::now();
+            while (!_sleeping.empty() && _sleeping.top().wakeUpTime <= now) {
+                _ready.push_back(_sleeping.top().handle);
+                _sleeping.pop();
+            }
+
+            if (!_ready.empty()) {
+                const auto handle = _ready.front();
+                _ready.pop_front();
+                lock.unlock();
+                handle.resume();
+                lock.lock();
+            } else if (!_sleeping.empty()) {
+                _condition.wait_until(lock, _sleeping.top().wakeUpTime);
+            } else {
+                _condition.wait(lock);
+            }
+        }
+    }
+  public:
+    void Start(Task& task) {
+        auto& promise = task.GetHandle().promise();
+        promise.loop = this;
+        promise.start = Clock::now();
+        {
+            std::lock_guard lock(_mutex);
+            ++_unfinishedCount;
+        }
+        Post(task.GetHandle());
+    }
+
+    // Thread safe, may be called from I/O completion callbacks
+    void Post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard lock(_mutex);
+            _ready.push_back(handle);
+        }
+        _condition.notify_one();
+    }
+
+    void PostAt(Clock::time_point wakeUpTime, std::coroutine_handle<> handle) {
+        {
+            std::lock_guard lock(_mutex);
+            _sleeping.push({wakeUpTime, handle});
+        }
+        _condition.notify_one();
+    }
+
+    void Finish() {
+        {
+            std::lock_guard lock(_mutex);
+            --_unfinishedCount;
+        }
+        _condition.notify_all();
+    }
+
+    void Run(size_t threadsCount) {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threadsCount; ++i)
+            workers.emplace_back([this] { ProcessUntilFinished(); });
+        ProcessUntilFinished();
+        for (auto& worker : workers)
+            worker.join();
+    }
+};
+
+std::coroutine_handle<> Task::FinalAwaiter::await_suspend(Handle handle) noexcept {
+    auto& promise = handle.promise();
+    if (promise.continuation)
+        return promise.continuation;
+
+    promise.finish = std::chrono::high_resolution_clock::now();
+    promise.loop->Finish();
+    return std::noop_coroutine();
+}
+
+void Sleep::await_suspend(Task::Handle handle) const {
+    handle.promise().loop->PostAt(std::chrono::high_resolution_clock::now() + _duration, handle);
+}
+
+void Yield::await_suspend(Task::Handle handle) const {
+    handle.promise().loop->Post(handle);
+}
+
+static char eventSetMarker;
+
+void Event::Set() {
+    const auto state = _state.exchange(&eventSetMarker, std::memory_order_acq_rel);
+    // The waiter may destroy this Event as soon as it is posted
+    if (state && state != &eventSetMarker)
+        _loop->Post(std::coroutine_handle<>::from_address(state));
+}
+
+bool Event::await_ready() const {
+    return _state.load(std::memory_order_acquire) == &eventSetMarker;
+}
+
+bool Event::await_suspend(Task::Handle handle) {
+    _loop = handle.promise().loop;
+    void* expected = nullptr;
+    return _state.compare_exchange_strong(expected, handle.address(), std::memory_order_acq_rel);
+}
+
+std::vector<CoroutineOutcome> RunCoroutines(const std::vector<Task (*)()>& coroutines, size_t threadsCount) {
+    EventLoop loop;
+    std::vector<Task> tasks;
+    tasks.reserve(coroutines.size());
+    for (const auto coroutine : coroutines)
+        tasks.push_back(coroutine());
+
+    for (auto& task : tasks)
+        loop.Start(task);
+    loop.Run(std::max<size_t>(1, threadsCount));
+
+    std::vector<CoroutineOutcome> outcomes;
+    for (const auto& task : tasks) {
+        const auto& promise = task.GetHandle().promise();
+        const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(promise.finish - promise.start);
+        outcomes.push_back({(uint64_t)time.count(), promise.exception});
+    }
+    return outcomes;
+}
+
+} // namespace UnitTestSystem
@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+namespace UnitTestSystem
+{
+
+class EventLoop;
+
+// Return type of coroutine test functions and of coroutines they co_await.
+// Owns the coroutine frame; the frame starts suspended and is resumed by the EventLoop.
+class Task {
+  public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        EventLoop* loop = nullptr;
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+        std::chrono::high_resolution_clock::time_point start;
+        std::chrono::high_resolution_clock::time_point finish;
+
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    // Awaiting a Task runs it on the same loop and resumes the caller when it finishes
+    struct Awaiter {
+        Handle handle;
+
+        bool await_ready() { return false; }
+        Handle await_suspend(Handle caller) {
+            handle.promise().loop = caller.promise().loop;
+            handle.promise().continuation = caller;
+            return handle;
+        }
+        void await_resume() {
+            if (handle.promise().exception)
+                std::rethrow_exception(handle.promise().exception);
+        }
+    };
+  private:
+    Handle _handle;
+  public:
+    explicit Task(Handle handle) : _handle(handle) {}
+    Task(Task&& other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    Awaiter operator co_await() { return Awaiter{_handle}; }
+
+    Handle GetHandle() const { return _handle; }
+};
+
+// co_await Sleep(10ms) suspends the test without blocking a loop thread
+class Sleep {
+  private:
+    std::chrono::nanoseconds _duration;
+  public:
+    explicit Sleep(std::chrono::nanoseconds duration) : _duration(duration) {}
+
+    bool await_ready() const { return _duration.count() <= 0; }
+    void await_suspend(Task::Handle handle) const;
+    void await_resume() const {}
+};
+
+// co_await Yield() lets other in-flight tests run
+class Yield {
+  public:
+    bool await_ready() const { return false; }
+    void await_suspend(Task::Handle handle) const;
+    void await_resume() const {}
+};
+
+// Bridges callback based async code: co_await event resumes the coroutine once Set() is called from any thread.
+// Only one coroutine may wait on an Event.
+class Event {
+  private:
+    std::atomic<void*> _state = nullptr; // nullptr, the "set" marker or the address of the waiting coroutine
+    EventLoop* _loop = nullptr;
+  public:
+    void Set();
+
+    bool await_ready() const;
+    bool await_suspend(Task::Handle handle);
+    void await_resume() {}
+};
+
+struct CoroutineOutcome {
+    uint64_t nanoseconds = 0;
+    std::exception_ptr exception;
+};
+
+// Starts all coroutines at once so I/O bound tests overlap, and waits until every one of them finishes
+std::vector<CoroutineOutcome> RunCoroutines(const std::vector<Task (*)()>& coroutines, size_t threadsCount);
+
+} // namespace UnitTestSystem
@@ -0,0 +1,35 @@
+#include "MemoryAllocator.h"
+#include <stdlib.h>
+
+namespace UnitTestSystem
+{
+
+std::atomic<uint64_t> MemoryAllocator::_used_bytes = 0;
+thread_local uint64_t MemoryAllocator::_untracked_scopes = 0;
+
+} // namespace UnitTestSystem
+
+void * operator new(size_t n)
+{
+    void* ptr = malloc(n + sizeof(n));
+    size_t* dataPtr = (size_t*)ptr;
+    ptr = (void*)(dataPtr + 1);
+    if (UnitTestSystem::MemoryAllocator::IsTracking()) {
+        dataPtr[0] = n;
+        UnitTestSystem::MemoryAllocator::AddUsedBytes(n);
+    } else {
+        dataPtr[0] = n | UnitTestSystem::MemoryAllocator::UntrackedFlag;
+    }
+    return ptr;
+}
+
+void operator delete(void * ptr) throw()
+{
+    size_t* dataPtr = (size_t*)ptr;
+    --dataPtr;
+    size_t n = *dataPtr;
+    ptr = (void*)(dataPtr);
+    if ((n & UnitTestSystem::MemoryAllocator::UntrackedFlag) == 0)
+        UnitTestSystem::MemoryAllocator::RemoveUsedBytes(n);
+    free(ptr);
+}
@@ -1,21 +1,38 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
-#include <stdlib.h>
+#include <atomic>
 
 namespace UnitTestSystem
 {
 
 class MemoryAllocator {
   private:
-    static uint64_t _used_bytes;
+    static std::atomic<uint64_t> _used_bytes;
+    static thread_local uint64_t _untracked_scopes;
     MemoryAllocator() {}
   public:
+    // Allocations made inside this scope are not counted, so the framework can keep
+    // its own bookkeeping alive past the end of a test without reporting it as a leak
+    class UntrackedScope {
+      public:
+        UntrackedScope() { ++_untracked_scopes; }
+        ~UntrackedScope() { --_untracked_scopes; }
+    };
+    
+    // Marks an allocation header as untracked
+    static constexpr size_t UntrackedFlag = (size_t)1 << (sizeof(size_t) * 8 - 1);
+    
+    static bool IsTracking() {
+        return _untracked_scopes == 0;
+    }
+    
     static void AddUsedBytes(uint64_t bytes) {
-        _used_bytes += bytes;
+        _used_bytes.fetch_add(bytes, std::memory_order_relaxed);
     }
     
     static void RemoveUsedBytes(uint64_t bytes) {
-        _used_bytes -= bytes;
+        _used_bytes.fetch_sub(bytes, std::memory_order_relaxed);
     }
     
     static void ResetUsedBytes() {
@@ -26,26 +43,5 @@ class MemoryAllocator {
         return _used_bytes;
     }
 };
-uint64_t MemoryAllocator::_used_bytes = 0;
 
 } // namespace UnitTestSystem
-
-void * operator new(size_t n)
-{
-    void* ptr = malloc(n + sizeof(n));
-    size_t* dataPtr = (size_t*)ptr;
-    dataPtr[0] = n;
-    ptr = (void*)(++dataPtr);
-    UnitTestSystem::MemoryAllocator::AddUsedBytes(n);
-    return ptr;
-}
-
-void operator delete(void * ptr) throw()
-{
-    size_t* dataPtr = (size_t*)ptr;
-    --dataPtr;
-    size_t n = *dataPtr;
-    ptr = (void*)(dataPtr);
-    UnitTestSystem::MemoryAllocator::RemoveUsedBytes(n);
-    free(ptr);
-}
@@ -0,0 +1,92 @@
+#include "Options.h"
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+namespace UnitTestSystem
+{
+
+Options Options::Parse(int argc, const char* argv[]) {
+    Options options;
+    bool isRepeatSet = false;
+    bool isSeedSet = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        try {
+            if (argument == "--repeat" && hasValue) {
+                options.repeat = std::stoull(argv[++i]);
+                isRepeatSet = true;
+            } else if (argument == "--shuffle") {
+                options.shuffle = true;
+            } else if (argument == "--seed" && hasValue) {
+                options.seed = std::stoull(argv[++i]);
+                isSeedSet = true;
+            } else if (argument == "--until-fail") {
+                options.untilFail = true;
+            } else if (argument == "--benchmark-threads" && hasValue) {
+                options.benchmarkThreads = ParseList(argv[++i]);
+            } else if (argument == "--benchmark-ops" && hasValue) {
+                const auto operations = std::stoull(argv[++i]);
+                if (operations == 0)
+                    throw std::invalid_argument("0 benchmark operations");
+                options.benchmarkOperations = operations;
+            } else if (argument == "--coroutine-threads" && hasValue) {
+                options.coroutineThreads = std::stoull(argv[++i]);
+            } else if (argument == "--trace" && hasValue) {
+                options.tracePath = argv[++i];
+            } else if (argument == "--update-snapshots") {
+                options.updateSnapshots = true;
+            } else if (argument == "--property-cases" && hasValue) {
+                options.propertyCases = std::stoull(argv[++i]);
+            } else if (argument == "--property-ms" && hasValue) {
+                options.propertyMilliseconds = std::stoull(argv[++i]);
+            } else if (argument == "--property-threads" && hasValue) {
+                options.propertyThreads = std::stoull(argv[++i]);
+            } else if (argument == "--property-seed" && hasValue) {
+                const std::string value = argv[++i];
+                const auto colon = value.rfind(':');
+                if (colon == std::string::npos || colon == 0)
+                    throw std::invalid_argument("expected Name:Seed");
+                options.propertySeed = std::stoull(value.substr(colon + 1));
+                options.propertySeedTest = value.substr(0, colon);
+            } else {
+                std::cerr << "Unknown argument is ignored: " << argument << '\n';
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Invalid argument is ignored: " << argument << ' ' << argv[i] << '\n';
+        }
+    }
+
+    if (options.untilFail && !isRepeatSet)
+        options.repeat = 0;
+    if (options.repeat == 0 && !options.untilFail) {
+        std::cerr << "--repeat 0 needs --until-fail, repeating once\n";
+        options.repeat = 1;
+    }
+    if (!isSeedSet)
+        options.seed = std::random_device()();
+
+    return options;
+}
+
+std::vector<size_t> Options::ParseList(const std::string& text) {
+    std::vector<size_t> values;
+    size_t begin = 0;
+    while (begin < text.length()) {
+        auto end = text.find(',', begin);
+        if (end == std::string::npos)
+            end = text.length();
+        if (end > begin) {
+            values.push_back(std::stoull(text.substr(begin, end - begin)));
+            if (values.back() == 0)
+                throw std::invalid_argument("0 in a list of counts");
+        }
+        begin = end + 1;
+    }
+    return values;
+}
+
+} // namespace UnitTestSystem
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace UnitTestSystem
+{
+
+struct Options {
+    uint64_t repeat = 1; // 0 with untilFail means "repeat until something fails"
+    bool shuffle = false;
+    uint64_t seed = 0;
+    bool untilFail = false;
+    std::vector<size_t> benchmarkThreads; // empty means powers of two up to the benchmark's own limit
+    uint64_t benchmarkOperations = 10000; // per thread
+    size_t coroutineThreads = 1; // threads driving the event loop of TEST_COROUTINE functions
+    std::string tracePath; // Chrome trace-event JSON written at exit, empty means no tracing
+    bool updateSnapshots = false; // MUST_MATCH_SNAPSHOT rewrites golden files instead of comparing
+    uint64_t propertyCases = 1000; // per PROPERTY_TEST
+    uint64_t propertyMilliseconds = 1000; // per PROPERTY_TEST, 0 means no time limit
+    size_t propertyThreads = 0; // 0 means one per hardware thread
+    std::string propertySeedTest; // PROPERTY_TEST that replays only the case with propertySeed
+    uint64_t propertySeed = 0;
+
+    // Supported arguments: --repeat N, --shuffle, --seed S, --until-fail,
+    // --benchmark-threads 1,2,4,8, --benchmark-ops N, --coroutine-threads N, --trace path,
+    // --update-snapshots, --property-cases N, --property-ms N, --property-threads N, --property-seed Name:S
+    static Options Parse(int argc, const char* argv[]);
+
+  private:
+    // Comma separated counts, throws std::invalid_argument unless all of them are at least 1
+    static std::vector<size_t> ParseList(const std::string& text);
+};
+
+} // namespace UnitTestSystem
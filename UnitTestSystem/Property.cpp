@@ -0,0 +1,57 @@
+#include "Property.h"
+#include "Threads.h"
+#include "Timer.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace UnitTestSystem
+{
+
+PropertyCases RunPropertyCases(const char* name, bool (*runCase)(const void* context, uint64_t seed), const void* context) {
+    const auto& options = TestContext::GetOptions();
+    PropertyCases cases;
+    if (options.propertySeedTest == name) {
+        cases.count = 1;
+        cases.isFailed = !runCase(context, options.propertySeed);
+        cases.failedSeed = options.propertySeed;
+        return cases;
+    }
+
+    const auto threadsCount = options.propertyThreads > 0 ? options.propertyThreads
+                                                          : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const auto maxNanoseconds = options.propertyMilliseconds * 1000000;
+    const Timer timer;
+
+    std::atomic<uint64_t> nextCase = 0;
+    std::atomic<uint64_t> casesCount = 0;
+    std::atomic<uint64_t> failedCase = UINT64_MAX;
+
+    // Cases are handed out by index, so the first failing index is the same however the threads interleave,
+    // as long as the budget doesn't run out first
+    RunOnThreads(threadsCount, [&](size_t) {
+        for (;;) {
+            const auto index = nextCase++;
+            if (index >= options.propertyCases || index > failedCase)
+                break;
+            if (maxNanoseconds > 0 && timer.GetNanoseconds() > maxNanoseconds)
+                break;
+
+            ++casesCount;
+            if (!runCase(context, PropertyRandom(options.seed + index).Next())) {
+                auto failed = failedCase.load();
+                while (index < failed && !failedCase.compare_exchange_weak(failed, index)) {}
+            }
+        }
+    });
+
+    cases.count = casesCount;
+    cases.isFailed = failedCase != UINT64_MAX;
+    if (cases.isFailed)
+        cases.failedSeed = PropertyRandom(options.seed + failedCase).Next();
+
+    TestContext::AddDetail(std::to_string(cases.count) + " case(s) on " + std::to_string(threadsCount) + " thread(s)");
+    return cases;
+}
+
+} // namespace UnitTestSystem
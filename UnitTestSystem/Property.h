@@ -0,0 +1,272 @@
+#pragma once
+#include "TestClassBase.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace UnitTestSystem
+{
+
+// SplitMix64. Unlike <random> distributions it gives the same cases for a seed on every standard library.
+class PropertyRandom {
+  private:
+    uint64_t _state;
+  public:
+    explicit PropertyRandom(uint64_t seed) : _state(seed) {}
+
+    uint64_t Next() {
+        auto z = (_state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, max]
+    uint64_t Next(uint64_t max) {
+        return max == UINT64_MAX ? Next() : Next() % (max + 1);
+    }
+};
+
+// A generator has a Value type, Generate(random), Shrink(value) listing simpler candidates, most aggressive first,
+// and ToString(value) for the report. Invalid bounds throw Error, which fails the property test.
+template <class T>
+class IntegerGenerator {
+  private:
+    T _min;
+    T _max;
+  public:
+    using Value = T;
+
+    IntegerGenerator(T min, T max) : _min(min), _max(max) {
+        if (min > max)
+            throw Error(0, "", "IntegerGenerator: min is greater than max");
+    }
+
+    T Generate(PropertyRandom& random) const {
+        return (T)((uint64_t)_min + random.Next((uint64_t)_max - (uint64_t)_min));
+    }
+
+    // Towards zero, or towards the bound closest to it
+    std::vector<T> Shrink(T value) const {
+        const T target = (_min > 0) ? _min : ((_max < 0) ? _max : 0);
+        std::vector<T> candidates;
+        if (value == target)
+            return candidates;
+
+        candidates.push_back(target);
+        const T half = value - (value - target) / 2;
+        if (half != value && half != target)
+            candidates.push_back(half);
+        const T step = (value > target) ? value - 1 : value + 1;
+        if (step != target && step != half)
+            candidates.push_back(step);
+        return candidates;
+    }
+
+    std::string ToString(T value) const { return std::to_string(value); }
+};
+
+// Drops the first or second half, then single elements, but never goes below minLength
+template <class Sequence>
+std::vector<Sequence> ShrinkSequence(const Sequence& value, size_t minLength) {
+    std::vector<Sequence> candidates;
+    const auto length = value.size();
+    if (length <= minLength)
+        return candidates;
+
+    const auto half = std::max(length / 2, minLength);
+    if (half < length) {
+        candidates.emplace_back(value.begin(), value.begin() + half);
+        candidates.emplace_back(value.end() - half, value.end());
+    }
+    for (size_t i = 0; i < length; ++i) {
+        candidates.push_back(value);
+        candidates.back().erase(candidates.back().begin() + i);
+    }
+    return candidates;
+}
+
+// Printable ASCII
+class StringGenerator {
+  private:
+    size_t _minLength;
+    size_t _maxLength;
+  public:
+    using Value = std::string;
+
+    StringGenerator(size_t minLength, size_t maxLength) : _minLength(minLength), _maxLength(maxLength) {
+        if (minLength > maxLength)
+            throw Error(0, "", "StringGenerator: minLength is greater than maxLength");
+    }
+
+    std::string Generate(PropertyRandom& random) const {
+        std::string value(_minLength + random.Next(_maxLength - _minLength), ' ');
+        for (auto& character : value)
+            character = (char)(' ' + random.Next('~' - ' '));
+        return value;
+    }
+
+    std::vector<std::string> Shrink(const std::string& value) const {
+        auto candidates = ShrinkSequence(value, _minLength);
+        for (size_t i = 0; i < value.length(); ++i) {
+            if (value[i] != 'a') {
+                candidates.push_back(value);
+                candidates.back()[i] = 'a';
+            }
+        }
+        return candidates;
+    }
+
+    std::string ToString(const std::string& value) const { return '"' + value + '"'; }
+};
+
+template <class ElementGenerator>
+class VectorGenerator {
+  private:
+    ElementGenerator _element;
+    size_t _minLength;
+    size_t _maxLength;
+  public:
+    using Element = typename ElementGenerator::Value;
+    using Value = std::vector<Element>;
+
+    VectorGenerator(ElementGenerator element, size_t minLength, size_t maxLength)
+    : _element(element), _minLength(minLength), _maxLength(maxLength) {
+        if (minLength > maxLength)
+            throw Error(0, "", "VectorGenerator: minLength is greater than maxLength");
+    }
+
+    Value Generate(PropertyRandom& random) const {
+        Value value(_minLength + random.Next(_maxLength - _minLength));
+        for (auto& element : value)
+            element = _element.Generate(random);
+        return value;
+    }
+
+    std::vector<Value> Shrink(const Value& value) const {
+        auto candidates = ShrinkSequence(value, _minLength);
+        for (size_t i = 0; i < value.size(); ++i) {
+            for (auto& element : _element.Shrink(value[i])) {
+                candidates.push_back(value);
+                candidates.back()[i] = std::move(element);
+            }
+        }
+        return candidates;
+    }
+
+    std::string ToString(const Value& value) const {
+        std::string text = "[";
+        for (size_t i = 0; i < value.size(); ++i)
+            text += (i == 0 ? "" : ", ") + _element.ToString(value[i]);
+        return text + "]";
+    }
+};
+
+struct PropertyCases {
+    uint64_t count = 0;
+    bool isFailed = false;
+    uint64_t failedSeed = 0;
+};
+
+// Runs runCase(context, caseSeed) on worker threads until --property-cases or --property-ms runs out, or replays
+// only the seed of --property-seed if it names this test. runCase returns false when the property doesn't hold.
+PropertyCases RunPropertyCases(const char* name, bool (*runCase)(const void* context, uint64_t seed), const void* context);
+
+template <class Generators>
+struct PropertyValuesOf;
+
+template <class... Generators>
+struct PropertyValuesOf<std::tuple<Generators...>> {
+    using Type = std::tuple<typename Generators::Value...>;
+};
+
+template <class Generators>
+using PropertyValues = typename PropertyValuesOf<Generators>::Type;
+
+template <class... Generators>
+class PropertyChecker {
+  public:
+    using Values = std::tuple<typename Generators::Value...>;
+  private:
+    static constexpr uint64_t MaxShrinksCount = 10000;
+
+    const char* _name;
+    std::tuple<Generators...> _generators;
+    void (*_function)(const Values&);
+
+    Values Generate(uint64_t seed) const {
+        PropertyRandom random(seed);
+        // Braced initialization generates the values left to right
+        return std::apply([&random](const auto&... generators) { return Values{generators.Generate(random)...}; },
+                          _generators);
+    }
+
+    // Empty if the property holds
+    Error Check(const Values& values) const {
+        try { _function(values); }
+        catch (...) { return Runner::GetError(std::current_exception()); }
+        return Error();
+    }
+
+    static bool RunCase(const void* context, uint64_t seed) {
+        const auto checker = (const PropertyChecker*)context;
+        return checker->Check(checker->Generate(seed)).Empty();
+    }
+
+    template <size_t Index>
+    bool ShrinkValue(Values& values, Error& error) const {
+        for (auto& candidate : std::get<Index>(_generators).Shrink(std::get<Index>(values))) {
+            auto shrunk = values;
+            std::get<Index>(shrunk) = std::move(candidate);
+            auto shrunkError = Check(shrunk);
+            if (shrunkError.NotEmpty()) {
+                values = std::move(shrunk);
+                error = std::move(shrunkError);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Greedy: takes the first simpler candidate that still fails, until none of them fails
+    template <size_t... Indices>
+    uint64_t Shrink(Values& values, Error& error, std::index_sequence<Indices...>) const {
+        uint64_t shrinksCount = 0;
+        while (shrinksCount < MaxShrinksCount && (ShrinkValue<Indices>(values, error) || ...))
+            ++shrinksCount;
+        return shrinksCount;
+    }
+
+    template <size_t... Indices>
+    std::string ToString(const Values& values, std::index_sequence<Indices...>) const {
+        std::string text;
+        ((text += (Indices == 0 ? "" : ", ") + std::get<Indices>(_generators).ToString(std::get<Indices>(values))), ...);
+        return "(" + text + ")";
+    }
+  public:
+    PropertyChecker(const char* name, std::tuple<Generators...> generators, void (*function)(const Values&))
+    : _name(name), _generators(std::move(generators)), _function(function) {}
+
+    void Run() const {
+        const auto cases = RunPropertyCases(_name, RunCase, this);
+        if (!cases.isFailed)
+            return;
+
+        auto values = Generate(cases.failedSeed);
+        auto error = Check(values);
+        const auto seed = std::string(_name) + ":" + std::to_string(cases.failedSeed);
+        if (error.Empty())
+            throw Error(0, "", "Failed once but passed when replayed, seed " + seed);
+
+        const auto shrinksCount = Shrink(values, error, std::index_sequence_for<Generators...>());
+        throw Error(error.line, error.code, error.message + " for " + ToString(values, std::index_sequence_for<Generators...>())
+                    + " after " + std::to_string(shrinksCount) + " shrink(s), replay with --property-seed " + seed);
+    }
+};
+
+} // namespace UnitTestSystem
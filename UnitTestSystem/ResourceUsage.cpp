@@ -0,0 +1,122 @@
+#include "ResourceUsage.h"
+#include "MemoryAllocator.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/resource.h>
+
+namespace UnitTestSystem
+{
+
+namespace
+{
+
+uint64_t ToNanoseconds(const timeval& time) {
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_usec * 1000;
+}
+
+uint64_t GetDifference(uint64_t end, uint64_t start) {
+    return end > start ? end - start : 0;
+}
+
+ResourceUsage GetProcessUsage() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    ResourceUsage result;
+    result.userNanoseconds = ToNanoseconds(usage.ru_utime);
+    result.systemNanoseconds = ToNanoseconds(usage.ru_stime);
+#if defined(__APPLE__)
+    result.peakResidentBytes = (uint64_t)usage.ru_maxrss;
+#else
+    result.peakResidentBytes = (uint64_t)usage.ru_maxrss * 1024;
+#endif
+    result.minorFaults = (uint64_t)usage.ru_minflt;
+    result.majorFaults = (uint64_t)usage.ru_majflt;
+    result.voluntarySwitches = (uint64_t)usage.ru_nvcsw;
+    result.involuntarySwitches = (uint64_t)usage.ru_nivcsw;
+    return result;
+}
+
+#if defined(__linux__)
+// Reads a "VmHWM:    1234 kB" line of /proc/self/status
+uint64_t ReadStatusBytes(const std::string& name) {
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, name.length(), name) == 0)
+            return std::stoull(line.substr(name.length())) * 1024;
+    }
+    return 0;
+}
+
+// Restarts VmHWM from the current RSS, so the next peak belongs to the running test
+bool ResetPeakResident() {
+    std::ofstream file("/proc/self/clear_refs");
+    file << "5";
+    file.close();
+    return !file.fail();
+}
+#endif
+
+} // namespace
+
+void ResourceUsage::Add(const ResourceUsage& other) {
+    userNanoseconds += other.userNanoseconds;
+    systemNanoseconds += other.systemNanoseconds;
+    peakResidentBytes = std::max(peakResidentBytes, other.peakResidentBytes);
+    minorFaults += other.minorFaults;
+    majorFaults += other.majorFaults;
+    voluntarySwitches += other.voluntarySwitches;
+    involuntarySwitches += other.involuntarySwitches;
+}
+
+std::string ResourceUsage::ToString() const {
+    std::stringstream ss;
+    ss << "cpu " << (double)userNanoseconds / 1e6 << "ms user + " << (double)systemNanoseconds / 1e6 << "ms sys"
+    << ", peak RSS +" << peakResidentBytes / 1024 << "KiB"
+    << ", page faults " << minorFaults << " minor / " << majorFaults << " major"
+    << ", context switches " << voluntarySwitches << " voluntary / " << involuntarySwitches << " involuntary";
+    return ss.str();
+}
+
+std::string ResourceLimits::GetViolation(const ResourceUsage& usage) const {
+    std::stringstream ss;
+    if (maxPeakResidentBytes > 0 && usage.peakResidentBytes > maxPeakResidentBytes)
+        ss << "Peak RSS +" << usage.peakResidentBytes / 1024 << "KiB is over the limit of " << maxPeakResidentBytes / 1024 << "KiB";
+    else if (maxCpuNanoseconds > 0 && usage.GetCpuNanoseconds() > maxCpuNanoseconds)
+        ss << "CPU time " << (double)usage.GetCpuNanoseconds() / 1e6 << "ms is over the limit of " << (double)maxCpuNanoseconds / 1e6 << "ms";
+    return ss.str();
+}
+
+// Without procfs the peak comes from ru_maxrss, which only grows when the test beats the peak of the whole process
+void ResourceMeter::Start() {
+    MemoryAllocator::UntrackedScope untracked;
+#if defined(__linux__)
+    _isPeakReset = ResetPeakResident();
+    if (_isPeakReset)
+        _startResidentBytes = ReadStatusBytes("VmRSS:");
+#endif
+    _start = GetProcessUsage();
+}
+
+ResourceUsage ResourceMeter::Stop() const {
+    MemoryAllocator::UntrackedScope untracked;
+    const auto end = GetProcessUsage();
+
+    ResourceUsage usage;
+    usage.userNanoseconds = GetDifference(end.userNanoseconds, _start.userNanoseconds);
+    usage.systemNanoseconds = GetDifference(end.systemNanoseconds, _start.systemNanoseconds);
+    usage.peakResidentBytes = GetDifference(end.peakResidentBytes, _start.peakResidentBytes);
+#if defined(__linux__)
+    if (_isPeakReset)
+        usage.peakResidentBytes = GetDifference(ReadStatusBytes("VmHWM:"), _startResidentBytes);
+#endif
+    usage.minorFaults = GetDifference(end.minorFaults, _start.minorFaults);
+    usage.majorFaults = GetDifference(end.majorFaults, _start.majorFaults);
+    usage.voluntarySwitches = GetDifference(end.voluntarySwitches, _start.voluntarySwitches);
+    usage.involuntarySwitches = GetDifference(end.involuntarySwitches, _start.involuntarySwitches);
+    return usage;
+}
+
+} // namespace UnitTestSystem
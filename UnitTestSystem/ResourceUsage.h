@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace UnitTestSystem
+{
+
+// Process-wide counters from getrusage and procfs. Unlike the operator new hook they also see mmap'd memory,
+// malloc from C libraries and CPU time of every thread the test starts.
+struct ResourceUsage {
+    uint64_t userNanoseconds = 0;
+    uint64_t systemNanoseconds = 0;
+    uint64_t peakResidentBytes = 0; // growth of the peak RSS over the RSS the test started with
+    uint64_t minorFaults = 0;
+    uint64_t majorFaults = 0;
+    uint64_t voluntarySwitches = 0;
+    uint64_t involuntarySwitches = 0;
+
+    uint64_t GetCpuNanoseconds() const { return userNanoseconds + systemNanoseconds; }
+
+    // Sums the counters of several iterations and keeps the largest peak
+    void Add(const ResourceUsage& other);
+    std::string ToString() const;
+};
+
+// Zero means no limit
+struct ResourceLimits {
+    uint64_t maxPeakResidentBytes = 0;
+    uint64_t maxCpuNanoseconds = 0;
+
+    bool IsAnySet() const { return maxPeakResidentBytes > 0 || maxCpuNanoseconds > 0; }
+
+    // Empty if the usage is within the limits
+    std::string GetViolation(const ResourceUsage& usage) const;
+};
+
+class ResourceMeter {
+  private:
+    ResourceUsage _start;
+    uint64_t _startResidentBytes = 0;
+    bool _isPeakReset = false;
+  public:
+    void Start();
+    ResourceUsage Stop() const;
+};
+
+} // namespace UnitTestSystem
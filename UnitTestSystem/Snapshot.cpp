@@ -0,0 +1,152 @@
+#include "Snapshot.h"
+#include "TestClassBase.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace UnitTestSystem
+{
+
+namespace
+{
+
+constexpr size_t ChunkSize = 1 << 20;
+constexpr size_t BytesPerRow = 16;
+
+// Read-only mapping of a whole regular file, an empty file is valid but not mapped
+class MappedFile {
+  private:
+    int _file = -1;
+    const unsigned char* _data = nullptr;
+    size_t _size = 0;
+    std::string _problem;
+  public:
+    explicit MappedFile(const std::string& path) {
+        _file = open(path.c_str(), O_RDONLY);
+        if (_file < 0) {
+            _problem = (errno == ENOENT) ? "is missing, run with --update-snapshots to create it"
+                                         : std::string("can't be opened: ") + strerror(errno);
+            return;
+        }
+
+        struct stat status;
+        if (fstat(_file, &status) != 0 || !S_ISREG(status.st_mode)) {
+            _problem = "is not a regular file";
+            return;
+        }
+        if (status.st_size == 0)
+            return;
+
+        auto data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, _file, 0);
+        if (data == MAP_FAILED) {
+            _problem = std::string("can't be mapped: ") + strerror(errno);
+            return;
+        }
+        madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+        _data = (const unsigned char*)data;
+        _size = (size_t)status.st_size;
+    }
+
+    ~MappedFile() {
+        if (_data)
+            munmap((void*)_data, _size);
+        if (_file >= 0)
+            close(_file);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Empty if the file can be compared
+    const std::string& GetProblem() const { return _problem; }
+    const unsigned char* GetData() const { return _data; }
+    size_t GetSize() const { return _size; }
+};
+
+// Offset of the first differing byte, or of the end of the shorter buffer if one is a prefix of the other.
+// memcmp skips equal chunks with the library's vectorized loop, only the differing chunk is scanned bytewise.
+size_t FindFirstDifference(const unsigned char* a, size_t aSize, const unsigned char* b, size_t bSize) {
+    const auto size = std::min(aSize, bSize);
+    size_t offset = 0;
+    while (offset < size) {
+        const auto chunk = std::min(ChunkSize, size - offset);
+        if (memcmp(a + offset, b + offset, chunk) != 0)
+            return offset + (size_t)(std::mismatch(a + offset, a + offset + chunk, b + offset).first - a - offset);
+        offset += chunk;
+    }
+    return size;
+}
+
+// "actual   00000010  68 65 6c 6c 6f 20 20 20 ...  hello..."
+std::string GetRow(const char* label, const unsigned char* data, size_t size, size_t rowOffset) {
+    std::stringstream ss;
+    ss << label << std::hex << std::setfill('0') << std::setw(8) << rowOffset << "  ";
+    for (size_t i = rowOffset; i < rowOffset + BytesPerRow; ++i) {
+        if (i < size)
+            ss << std::setw(2) << (unsigned)data[i] << ' ';
+        else
+            ss << "   ";
+    }
+    ss << ' ';
+    for (size_t i = rowOffset; i < std::min(rowOffset + BytesPerRow, size); ++i)
+        ss << (char)((data[i] >= 0x20 && data[i] < 0x7f) ? data[i] : '.');
+    return ss.str();
+}
+
+// Two rows around the difference for each side, with a marker under the first differing byte
+void AddDifferenceWindow(const unsigned char* actual, size_t actualSize,
+                         const unsigned char* snapshot, size_t snapshotSize, size_t offset) {
+    const auto rowOffset = offset / BytesPerRow * BytesPerRow;
+    const auto firstRow = rowOffset >= BytesPerRow ? rowOffset - BytesPerRow : 0;
+    for (auto row = firstRow; row <= rowOffset; row += BytesPerRow) {
+        TestContext::AddDetail(GetRow("actual   ", actual, actualSize, row));
+        TestContext::AddDetail(GetRow("snapshot ", snapshot, snapshotSize, row));
+    }
+    TestContext::AddDetail(std::string(19 + (offset - rowOffset) * 3, ' ') + "^^");
+}
+
+void UpdateSnapshot(const void* data, size_t size, const std::string& path, uint64_t line, const std::string& code) {
+    const auto temporaryPath = path + ".tmp" + std::to_string(getpid());
+    auto file = fopen(temporaryPath.c_str(), "wb");
+    bool isWritten = file && fwrite(data, 1, size, file) == size;
+    // The data must be on disk before the rename, or a crash can leave a truncated golden file
+    isWritten = isWritten && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (file)
+        isWritten &= fclose(file) == 0;
+
+    if (!isWritten || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        remove(temporaryPath.c_str());
+        throw Error(line, code, "Can't update snapshot " + path);
+    }
+}
+
+} // namespace
+
+void MustMatchSnapshot(const void* data, size_t size, const std::string& path, uint64_t line, const std::string& code) {
+    if (TestContext::GetOptions().updateSnapshots) {
+        UpdateSnapshot(data, size, path, line, code);
+        return;
+    }
+
+    const MappedFile snapshot(path);
+    if (!snapshot.GetProblem().empty())
+        throw Error(line, code, "Snapshot " + path + " " + snapshot.GetProblem());
+
+    const auto actual = (const unsigned char*)data;
+    const auto offset = FindFirstDifference(actual, size, snapshot.GetData(), snapshot.GetSize());
+    if (offset == size && offset == snapshot.GetSize())
+        return;
+
+    AddDifferenceWindow(actual, size, snapshot.GetData(), snapshot.GetSize(), offset);
+    throw Error(line, code, "Differs from " + path + " at offset " + std::to_string(offset)
+                + " (" + std::to_string(size) + " vs " + std::to_string(snapshot.GetSize()) + " bytes)");
+}
+
+} // namespace UnitTestSystem
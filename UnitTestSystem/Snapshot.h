@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace UnitTestSystem
+{
+
+// Compares the data with the golden file at path without loading it: the file is memory-mapped and compared
+// in chunks. The first difference is reported with a hex/text window of both sides. With --update-snapshots
+// the golden file is rewritten instead, through a temporary file renamed over it.
+void MustMatchSnapshot(const void* data, size_t size, const std::string& path, uint64_t line, const std::string& code);
+
+// Any contiguous container: std::string, std::string_view, std::vector, std::array...
+template <class Buffer>
+void MustMatchSnapshot(const Buffer& buffer, const std::string& path, uint64_t line, const std::string& code) {
+    MustMatchSnapshot(buffer.data(), buffer.size() * sizeof(*buffer.data()), path, line, code);
+}
+
+} // namespace UnitTestSystem
@@ -0,0 +1,12 @@
+#include "Stress.h"
+#include "Threads.h"
+#include <algorithm>
+
+namespace UnitTestSystem
+{
+
+void RunStress(void (*function)(), size_t threadsCount) {
+    RunOnThreads(std::max<size_t>(threadsCount, 1), [function](size_t) { function(); });
+}
+
+} // namespace UnitTestSystem
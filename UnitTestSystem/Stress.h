@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+namespace UnitTestSystem
+{
+
+// Runs the same function on threadsCount threads that start together, at least one, see STRESS_FUNCTION
+void RunStress(void (*function)(), size_t threadsCount);
+
+} // namespace UnitTestSystem
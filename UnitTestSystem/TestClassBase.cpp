@@ -0,0 +1,302 @@
+#include "TestClassBase.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+namespace UnitTestSystem
+{
+
+void FunctionResult::AddIteration(uint64_t nanoseconds, const Error& iterationError) {
+    minIterationNanoseconds = (iterationsCount == 0) ? nanoseconds : std::min(minIterationNanoseconds, nanoseconds);
+    maxIterationNanoseconds = std::max(maxIterationNanoseconds, nanoseconds);
+    timeElapsedNanoseconds += nanoseconds;
+    ++iterationsCount;
+
+    if (iterationError.NotEmpty()) {
+        ++failedIterationsCount;
+        if (IsSuccess())
+            error = iterationError;
+    }
+}
+
+std::string FunctionResult::GetMessage(size_t longestNameLength, size_t longestDescriptionLength) const
+{
+    if (!IsPrint())
+        return "";
+
+    std::stringstream ss;
+
+    const auto description = GetDescription();
+    const auto extra = GetExtra();
+    const std::string arrow = " <-- ";
+
+    ss << name << std::setw((int)(longestNameLength + 1 - name.length())) << ' ';
+    ss << description << std::setw((int)(longestDescriptionLength + arrow.length() - description.length())) << arrow << extra << '\n';
+    if (IsSuccess() && isResourceMeasured)
+        ss << std::string(longestNameLength + 1, ' ') << resources.ToString() << '\n';
+    for (const auto& detail : details)
+        ss << std::string(longestNameLength + 1, ' ') << detail << '\n';
+
+    return ss.str();
+}
+
+std::string FunctionResult::GetDescription() const
+{
+    if (IsFailed()) {
+        std::stringstream ss;
+        ss << "FAILED Line " << error.line << ": " << error.code;
+        return ss.str();
+    } else {
+        return "PASSED ";
+    }
+}
+
+std::string FunctionResult::GetExtra() const
+{
+    std::stringstream ss;
+    if (IsFailed()) {
+        ss << error.message;
+        if (iterationsCount > 1)
+            ss << " (failed " << failedIterationsCount << " / " << iterationsCount << " iterations)";
+    } else {
+        ss << (double)timeElapsedNanoseconds / 1e6 << "ms elapsed";
+        if (iterationsCount > 1) {
+            ss << " (" << iterationsCount << " iterations, min " << (double)minIterationNanoseconds / 1e6
+            << "ms, max " << (double)maxIterationNanoseconds / 1e6 << "ms)";
+        }
+    }
+    return ss.str();
+}
+
+const Options* TestContext::_options = nullptr;
+FunctionResult* TestContext::_currentResult = nullptr;
+
+const Options& TestContext::GetOptions() {
+    static const Options defaultOptions;
+    return _options ? *_options : defaultOptions;
+}
+
+// Stress and property tests add details from several threads
+static std::mutex detailsMutex;
+
+void TestContext::AddDetail(const std::string& detail) {
+    if (!_currentResult)
+        return;
+    MemoryAllocator::UntrackedScope untracked;
+    std::lock_guard lock(detailsMutex);
+    _currentResult->details.push_back(detail);
+}
+
+struct Runner::Stats {
+    size_t allCount = 0;
+    size_t successfulCount = 0;
+    uint64_t timeElapsed = 0;
+    size_t longestNameLength = 0;
+    size_t longestDescriptionLength = 0;
+    size_t longestExtraLength = 0;
+
+    bool IsSuccess() const {
+        return successfulCount == allCount;
+    }
+};
+
+void Runner::Run(const char* moduleName, const FunctionInfo* firstFunction, const Options& options) {
+    if (!options.tracePath.empty())
+        Trace::Enable(options.tracePath);
+    TraceScope moduleScope(moduleName);
+
+    TestContext::_options = &options;
+    const auto results = RunAndGetResults(firstFunction, options);
+    TestContext::_options = nullptr;
+
+    TraceScope reportScope("report");
+    const auto stats = GetStats(results);
+
+    std::cout << moduleName << ": ";
+    std::cout << "( " << stats.successfulCount << " / " << stats.allCount << " )"
+    << " in " << (double)stats.timeElapsed / 1e9 << "s " << (stats.IsSuccess() ? "PASSED": "FAILED");
+    if (options.shuffle)
+        std::cout << " (shuffled with seed " << options.seed << ")";
+    std::cout << '\n';
+
+    const auto lineLength = 6 + stats.longestNameLength + stats.longestDescriptionLength + stats.longestExtraLength;
+    PrintLine(lineLength);
+    for (const auto& result : results)
+        std::cout << result.GetMessage(stats.longestNameLength, stats.longestDescriptionLength);
+    PrintLine(lineLength);
+    std::cout << std::endl;
+}
+
+std::vector<FunctionResult> Runner::RunAndGetResults(const FunctionInfo* firstFunction, const Options& options) {
+    std::vector<const FunctionInfo*> functions;
+    std::vector<FunctionResult> results;
+    std::vector<size_t> order;
+    {
+        TraceScope setupScope("setup");
+        for (auto info = firstFunction; info; info = info->next)
+            functions.push_back(info);
+        if (functions.empty())
+            return {};
+
+        results.resize(functions.size());
+        for (size_t i = 0; i < functions.size(); ++i) {
+            results[i].name = functions[i]->name;
+            results[i].isTimeMeasuring = functions[i]->timeMeasuring;
+        }
+
+        order.resize(functions.size());
+        std::iota(order.begin(), order.end(), 0);
+    }
+    std::mt19937_64 random(options.seed);
+
+    for (uint64_t iteration = 0; (options.untilFail && options.repeat == 0) || iteration < options.repeat; ++iteration) {
+        if (options.shuffle)
+            std::shuffle(order.begin(), order.end(), random);
+
+        bool isAnyFailed = false;
+        std::vector<size_t> coroutineIndices;
+        for (const auto index : order) {
+            if (functions[index]->coroutine)
+                coroutineIndices.push_back(index);
+            else
+                isAnyFailed |= !RunIteration(*functions[index], results[index]);
+        }
+        if (!coroutineIndices.empty())
+            isAnyFailed |= !RunCoroutinesIteration(functions, coroutineIndices, results, options);
+
+        if (options.untilFail && isAnyFailed)
+            break;
+    }
+
+    return results;
+}
+
+bool Runner::RunIteration(const FunctionInfo& function, FunctionResult& result) {
+    Error error;
+    Timer timer;
+    ResourceMeter meter;
+
+    // Details belong to the reported error, which is the first failing iteration's
+    if (result.IsSuccess())
+        result.details.clear();
+    TestContext::_currentResult = result.IsSuccess() ? &result : nullptr;
+    const auto traceStart = Trace::IsEnabled() ? Trace::GetTimestamp() : 0;
+
+    // Metering costs tens of microseconds, too much for every test of a large binary
+    const bool isMetering = function.timeMeasuring || function.limits.IsAnySet();
+    if (isMetering)
+        meter.Start();
+    MemoryAllocator::ResetUsedBytes();
+    timer.Restart();
+
+    try { function.function(); }
+    catch (...) { error = GetError(std::current_exception()); }
+
+    const auto timeElapsed = timer.GetNanoseconds();
+    const auto usage = isMetering ? meter.Stop() : ResourceUsage();
+    TestContext::_currentResult = nullptr;
+    if (Trace::IsEnabled())
+        Trace::AddEvent(function.name, "test", traceStart, traceStart + timeElapsed);
+
+    if (error.Empty()) {
+        const auto bytesLeaked = MemoryAllocator::GetUsedBytes();
+        if (bytesLeaked > 0)
+            error = Error(0, "", "Memory leak: " + std::to_string(bytesLeaked) + " byte(s)");
+    }
+    if (isMetering && error.Empty()) {
+        const auto violation = function.limits.GetViolation(usage);
+        if (!violation.empty())
+            error = Error(0, "", violation);
+    }
+
+    if (isMetering) {
+        result.resources.Add(usage);
+        result.isResourceMeasured = true;
+    }
+
+    result.AddIteration(timeElapsed, error);
+    return error.Empty();
+}
+
+// All coroutines of the module are in flight together, so their allocations can't be told apart
+// and they are not checked for memory leaks
+bool Runner::RunCoroutinesIteration(const std::vector<const FunctionInfo*>& functions,
+                                    const std::vector<size_t>& indices,
+                                    std::vector<FunctionResult>& results,
+                                    const Options& options) {
+    std::vector<Task (*)()> coroutines;
+    for (const auto index : indices)
+        coroutines.push_back(functions[index]->coroutine);
+
+    const auto traceStart = Trace::IsEnabled() ? Trace::GetTimestamp() : 0;
+    const auto outcomes = RunCoroutines(coroutines, options.coroutineThreads);
+
+    bool isAllSuccess = true;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        const auto error = outcomes[i].exception ? GetError(outcomes[i].exception) : Error();
+        auto& result = results[indices[i]];
+        if (result.IsSuccess())
+            result.details.clear();
+        result.AddIteration(outcomes[i].nanoseconds, error);
+        isAllSuccess &= error.Empty();
+        if (Trace::IsEnabled())
+            Trace::AddAsyncEvent(functions[indices[i]]->name, "coroutine", traceStart, traceStart + outcomes[i].nanoseconds);
+    }
+    return isAllSuccess;
+}
+
+Error Runner::GetError(const std::exception_ptr& exception) {
+    try { std::rethrow_exception(exception); }
+    catch (const Error& error) { return error; }
+    catch (const Assert& assert) {
+        return Error(assert.line, assert.code, "Assert triggered!");
+    }
+    catch (...) {
+        return Error(0, "", "Unknown exception occured!");
+    }
+}
+
+Runner::Stats Runner::GetStats(const std::vector<FunctionResult>& results) {
+    Stats stats;
+    stats.allCount = results.size();
+
+    for (const auto& result : results) {
+        if (result.IsSuccess())
+            ++stats.successfulCount;
+        stats.timeElapsed += result.timeElapsedNanoseconds;
+        stats.longestNameLength = std::max(stats.longestNameLength, result.name.length());
+        stats.longestDescriptionLength = std::max(stats.longestDescriptionLength, result.GetDescription().length());
+        stats.longestExtraLength = std::max(stats.longestExtraLength, result.GetExtra().length());
+    }
+
+    return stats;
+}
+
+void Runner::PrintLine(size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        std::cout << "=";
+    std::cout << '\n';
+}
+
+void MustBeTrue(bool a, uint64_t line, const std::string& code) {
+    if (!a)
+        throw Error(line, code, "Expected True but was False");
+}
+
+void MustBeFalse(bool a, uint64_t line, const std::string& code) {
+    if (a)
+        throw Error(line, code, "Expected False but was True");
+}
+
+void MustBeCloseDoubles(double a, double b, uint64_t line, const std::string& aCode, const std::string& bCode) {
+    if (fabs(a - b) > std::max(fabs(a), fabs(b)) * 1e-5)
+        throw Error(line, aCode + " ~= " + bCode, std::to_string(a) + " != " + std::to_string(b));
+}
+
+} // namespace UnitTestSystem
@@ -1,9 +1,13 @@
 #pragma once
 #include "Timer.h"
 #include "MemoryAllocator.h"
-#include <iostream>
-#include <iomanip>
-#include <functional>
+#include "Options.h"
+#include "Coroutine.h"
+#include "ResourceUsage.h"
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
 
 namespace UnitTestSystem
 {
@@ -16,7 +20,7 @@ struct Error {
     Error() {}
     Error(uint64_t line, const std::string& code, const std::string& message)
     : line(line), code(code), message(message) {}
-    
+
     bool Empty() const { return (line == 0) && code.empty() && message.empty(); }
     bool NotEmpty() const { return !Empty(); }
 };
@@ -24,7 +28,7 @@ struct Error {
 struct Assert {
     uint64_t line;
     std::string code;
-    
+
     Assert(uint64_t line, const std::string& code)
     : line(line), code(code) {}
 };
@@ -34,176 +38,113 @@ struct FunctionResult {
     Error error;
     uint64_t timeElapsedNanoseconds = 0;
     bool isTimeMeasuring = false;
-    
+
+    uint64_t iterationsCount = 0;
+    uint64_t failedIterationsCount = 0;
+    uint64_t minIterationNanoseconds = 0;
+    uint64_t maxIterationNanoseconds = 0;
+
+    // Summed over the iterations of time measuring tests and tests with limits, printed for the former.
+    // Coroutine tests are not measured.
+    ResourceUsage resources;
+    bool isResourceMeasured = false;
+
+    // Extra report lines printed under the result, e.g. benchmark tables
+    std::vector<std::string> details;
+
+    // Keeps the first error, so a flaky function reports its first failure and how often it failed
+    void AddIteration(uint64_t nanoseconds, const Error& iterationError);
+
     bool IsPrint() const { return IsFailed() || (IsSuccess() && isTimeMeasuring);}
     bool IsSuccess() const { return error.Empty(); }
     bool IsFailed() const { return !IsSuccess(); }
-    
-    std::string GetMessage(size_t longestNameLength, size_t longestDescriptionLength) const
-    {
-        if (!IsPrint())
-            return "";
-        
-        std::stringstream ss;
-        
-        const auto description = GetDescription();
-        const auto extra = GetExtra();
-        const std::string arrow = " <-- ";
-        
-        ss << name << std::setw((int)(longestNameLength + 1 - name.length())) << ' ';
-        ss << description << std::setw((int)(longestDescriptionLength + arrow.length() - description.length())) << arrow << extra << '\n';
-            
-        return ss.str();
-    }
-    
-    std::string GetDescription() const
-    {
-        if (IsFailed()) {
-            std::stringstream ss;
-            ss << "FAILED Line " << error.line << ": " << error.code;
-            return ss.str();
-        } else {
-            return "PASSED ";
-        }
-        
-    }
-    
-    std::string GetExtra() const
-    {
-        if (IsFailed()) {
-            return error.message;
-        } else {
-            std::stringstream ss;
-            ss << (double)timeElapsedNanoseconds / 1e6 << "ms elapsed";
-            return ss.str();
-        }
-    }
+
+    std::string GetMessage(size_t longestNameLength, size_t longestDescriptionLength) const;
+    std::string GetDescription() const;
+    std::string GetExtra() const;
+};
+
+// Static-storage descriptor of a single test function. Registration only links it
+// into the module's intrusive list, so nothing is allocated before main.
+struct FunctionInfo {
+    const char* name;
+    void (*function)() = nullptr;
+    Task (*coroutine)() = nullptr;
+    bool timeMeasuring;
+    ResourceLimits limits = {};
+    FunctionInfo* next = nullptr;
 };
 
 template <class T>
 class FunctionRegister {
+  private:
+    FunctionInfo _info;
   public:
-    FunctionRegister(const std::string& name, const std::function<void()>& testFunction, bool timeMeasuring) {
-        T::AddTestFunction(name, testFunction, timeMeasuring);
+    FunctionRegister(const char* name, void (*testFunction)(), bool timeMeasuring, ResourceLimits limits = ResourceLimits())
+    : _info{name, testFunction, nullptr, timeMeasuring, limits} {
+        T::AddTestFunction(&_info);
+    }
+
+    FunctionRegister(const char* name, Task (*testCoroutine)(), bool timeMeasuring)
+    : _info{name, nullptr, testCoroutine, timeMeasuring} {
+        T::AddTestFunction(&_info);
     }
 };
 
+// Gives code running inside a test function access to the runner's state
+class TestContext {
+  private:
+    friend class Runner;
+
+    static const Options* _options;
+    static FunctionResult* _currentResult;
+  public:
+    static const Options& GetOptions();
+    static void AddDetail(const std::string& detail);
+};
+
+// Runs and prints a module. It is compiled once in TestClassBase.cpp instead of in every test file.
+class Runner {
+  public:
+    static void Run(const char* moduleName, const FunctionInfo* firstFunction, const Options& options);
+    // Error, Assert or anything else thrown by a test, as it is reported
+    static Error GetError(const std::exception_ptr& exception);
+  private:
+    struct Stats;
+
+    static std::vector<FunctionResult> RunAndGetResults(const FunctionInfo* firstFunction, const Options& options);
+    static bool RunIteration(const FunctionInfo& function, FunctionResult& result);
+    static bool RunCoroutinesIteration(const std::vector<const FunctionInfo*>& functions,
+                                       const std::vector<size_t>& indices,
+                                       std::vector<FunctionResult>& results,
+                                       const Options& options);
+    static Stats GetStats(const std::vector<FunctionResult>& results);
+    static void PrintLine(size_t count);
+};
+
 template <class T>
 class Base {
   private:
     friend class FunctionRegister<T>;
-    
-    struct FunctionInfo {
-        std::string name;
-        std::function<void()> function;
-        bool timeMeasuring;
-    };
-    static inline std::vector<FunctionInfo> _functionsInfo;
-    
-    static void AddTestFunction(const std::string& name, const std::function<void()>& testFunction, bool timeMeasuring) {
-        _functionsInfo.push_back({name, testFunction, timeMeasuring});
+
+    static inline FunctionInfo* _firstFunction = nullptr;
+    static inline FunctionInfo* _lastFunction = nullptr;
+
+    static void AddTestFunction(FunctionInfo* function) {
+        if (_lastFunction)
+            _lastFunction->next = function;
+        else
+            _firstFunction = function;
+        _lastFunction = function;
     }
   public:
-    static void Run() {
-        const auto results = RunAndGetResults();
-        const auto stats = GetStats(results);
-        
-        std::cout << T::GetName() << ": ";
-        std::cout << "( " << stats.successfulCount << " / " << stats.allCount << " )"
-        << " in " << (double)stats.timeElapsed / 1e9 << "s " << (stats.IsSuccess() ? "PASSED\n": "FAILED\n");
-        
-        const auto lineLength = 6 + stats.longestNameLength + stats.longestDescriptionLength + stats.longestExtraLength;
-        PrintLine(lineLength);
-        for (const auto& result : results)
-            std::cout << result.GetMessage(stats.longestNameLength, stats.longestDescriptionLength);
-        PrintLine(lineLength);
-        std::cout << std::endl;
-    }
-  private:
-    static std::vector<FunctionResult> RunAndGetResults() {
-        std::vector<FunctionResult> results;
-        Timer timer;
-        
-        for (const auto& info : _functionsInfo) {
-            FunctionResult result;
-            result.name = info.name;
-            result.isTimeMeasuring = info.timeMeasuring;
-            
-            MemoryAllocator::ResetUsedBytes();
-            timer.Restart();
-            
-            try { info.function(); }
-            catch (const Error& error) { result.error = error; }
-            catch (const Assert& assert) {
-                Error error(assert.line, assert.code, "Assert triggered!");
-                result.error = error;
-            }
-            catch (...) {
-                Error error(0, "", "Unknown exception occured!");
-                result.error = error;
-            }
-            
-            result.timeElapsedNanoseconds = timer.GetNanoseconds();
-            
-            if (result.IsSuccess()) {
-                const auto bytesLeaked = MemoryAllocator::GetUsedBytes();
-                if (bytesLeaked > 0){
-                    Error error(0, "", "Memory leak: " + std::to_string(bytesLeaked) + " byte(s)");
-                    result.error = error;
-                }
-            }
-            
-            results.push_back(result);
-        }
-            
-        return results;
-    }
-    
-    struct Stats {
-        size_t allCount = 0;
-        size_t successfulCount = 0;
-        uint64_t timeElapsed = 0;
-        size_t longestNameLength = 0;
-        size_t longestDescriptionLength = 0;
-        size_t longestExtraLength = 0;
-        
-        bool IsSuccess() const {
-            return successfulCount == allCount;
-        }
-    };
-    
-    static Stats GetStats(const std::vector<FunctionResult>& results) {
-        Stats stats;
-        stats.allCount = results.size();
-        
-        for (const auto& result : results) {
-            if (result.IsSuccess())
-                ++stats.successfulCount;
-            stats.timeElapsed += result.timeElapsedNanoseconds;
-            stats.longestNameLength = std::max(stats.longestNameLength, result.name.length());
-            stats.longestDescriptionLength = std::max(stats.longestDescriptionLength, result.GetDescription().length());
-            stats.longestExtraLength = std::max(stats.longestExtraLength, result.GetExtra().length());
-        }
-        
-        return stats;
-    }
-    
-    static void PrintLine(size_t count) {
-        for (size_t i = 0; i < count; ++i)
-            std::cout << "=";
-        std::cout << '\n';
+    static void Run(const Options& options = Options()) {
+        Runner::Run(T::GetName(), _firstFunction, options);
     }
 };
 
-void MustBeTrue(bool a, uint64_t line, const std::string& code) {
-    if (!a)
-        throw Error(line, code, "Expected True but was False");
-}
-
-void MustBeFalse(bool a, uint64_t line, const std::string& code) {
-    if (a)
-        throw Error(line, code, "Expected False but was True");
-}
+void MustBeTrue(bool a, uint64_t line, const std::string& code);
+void MustBeFalse(bool a, uint64_t line, const std::string& code);
 
 template <class T1, class T2>
 void MustBeEqual(T1 a, T2 b, uint64_t line, const std::string& aCode, const std::string& bCode) {
@@ -211,10 +152,6 @@ void MustBeEqual(T1 a, T2 b, uint64_t line, const std::string& aCode, const std:
         throw Error(line, aCode + " == " + bCode, std::to_string(a) + " != " + std::to_string(b));
 }
 
-void MustBeCloseDoubles(double a, double b, uint64_t line, const std::string& aCode, const std::string& bCode) {
-    if (fabs(a - b) > std::max(fabs(a), fabs(b)) * 1e-5)
-        throw Error(line, aCode + " ~= " + bCode, std::to_string(a) + " != " + std::to_string(b));
-}
+void MustBeCloseDoubles(double a, double b, uint64_t line, const std::string& aCode, const std::string& bCode);
 
 } // namespace UnitTestSystem
-
@@ -0,0 +1,42 @@
+#pragma once
+#include "Trace.h"
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace UnitTestSystem
+{
+
+// Runs function(threadIndex) on threadsCount threads that are released together by a start latch.
+// The first exception thrown by any of them is rethrown after all threads are joined.
+template <class Function>
+void RunOnThreads(size_t threadsCount, const Function& function) {
+    std::latch start((ptrdiff_t)threadsCount);
+    std::mutex exceptionMutex;
+    std::exception_ptr firstException;
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadsCount);
+    for (size_t i = 0; i < threadsCount; ++i) {
+        threads.emplace_back([&, i] {
+            start.arrive_and_wait();
+            TraceScope scope("worker");
+            try { function(i); }
+            catch (...) {
+                std::lock_guard lock(exceptionMutex);
+                if (!firstException)
+                    firstException = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (firstException)
+        std::rethrow_exception(firstException);
+}
+
+} // namespace UnitTestSystem
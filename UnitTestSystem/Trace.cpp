@@ -0,0 +1,140 @@
+#include "Trace.h"
+#include "Timer.h"
+#include "MemoryAllocator.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace UnitTestSystem
+{
+
+namespace
+{
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    uint64_t start;
+    uint64_t end;
+    uint64_t asyncId;
+    bool isAsync;
+};
+
+// Written only by its own thread, read only when the program exits
+struct TraceBuffer {
+    uint64_t threadId;
+    std::vector<TraceEvent> events;
+};
+
+class TraceSession {
+  private:
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> _buffers;
+
+    static void WriteEscaped(std::ofstream& file, const char* text) {
+        for (; *text; ++text) {
+            if (*text == '"' || *text == '\\')
+                file << '\\';
+            if ((unsigned char)*text >= 0x20)
+                file << *text;
+        }
+    }
+
+    static void WriteEvent(std::ofstream& file, const TraceEvent& event, uint64_t threadId, const char* phase, uint64_t timestamp) {
+        file << ",\n{\"name\":\"";
+        WriteEscaped(file, event.name);
+        file << "\",\"cat\":\"" << event.category << "\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << threadId
+        << ",\"ts\":" << (double)timestamp / 1e3;
+        if (event.isAsync)
+            file << ",\"id\":" << event.asyncId;
+        else
+            file << ",\"dur\":" << (double)(event.end - event.start) / 1e3;
+        file << '}';
+    }
+  public:
+    Timer epoch;
+    std::string path;
+
+    TraceBuffer& GetThreadBuffer() {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (!buffer) {
+            MemoryAllocator::UntrackedScope untracked;
+            std::lock_guard lock(_mutex);
+            _buffers.push_back(std::make_unique<TraceBuffer>());
+            buffer = _buffers.back().get();
+            buffer->threadId = _buffers.size();
+        }
+        return *buffer;
+    }
+
+    ~TraceSession() {
+        if (path.empty())
+            return;
+
+        std::ofstream file(path);
+        // Microseconds with nanosecond digits, the default 6 significant digits lose resolution after a second
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"UnitTestSystem\"}}";
+        for (const auto& buffer : _buffers) {
+            file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+            << ",\"args\":{\"name\":\"" << (buffer->threadId == 1 ? "runner" : "worker ");
+            if (buffer->threadId != 1)
+                file << buffer->threadId - 1;
+            file << "\"}}";
+
+            for (const auto& event : buffer->events) {
+                if (event.isAsync) {
+                    WriteEvent(file, event, buffer->threadId, "b", event.start);
+                    WriteEvent(file, event, buffer->threadId, "e", event.end);
+                } else {
+                    WriteEvent(file, event, buffer->threadId, "X", event.start);
+                }
+            }
+        }
+        file << "\n]}\n";
+    }
+};
+
+TraceSession& GetTraceSession() {
+    static TraceSession session;
+    return session;
+}
+
+void AddTraceEvent(const TraceEvent& event) {
+    auto& buffer = GetTraceSession().GetThreadBuffer();
+    MemoryAllocator::UntrackedScope untracked;
+    buffer.events.push_back(event);
+}
+
+} // namespace
+
+bool Trace::_isEnabled = false;
+
+void Trace::Enable(const std::string& path) {
+    if (_isEnabled)
+        return;
+    MemoryAllocator::UntrackedScope untracked;
+    auto& session = GetTraceSession();
+    session.path = path;
+    session.GetThreadBuffer();
+    _isEnabled = true;
+}
+
+uint64_t Trace::GetTimestamp() {
+    return GetTraceSession().epoch.GetNanoseconds();
+}
+
+void Trace::AddEvent(const char* name, const char* category, uint64_t start, uint64_t end) {
+    AddTraceEvent({name, category, start, end, 0, false});
+}
+
+void Trace::AddAsyncEvent(const char* name, const char* category, uint64_t start, uint64_t end) {
+    static std::atomic<uint64_t> lastId = 0;
+    AddTraceEvent({name, category, start, end, ++lastId, true});
+}
+
+} // namespace UnitTestSystem
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace UnitTestSystem
+{
+
+// Chrome trace-event / Perfetto timeline, enabled by --trace path and written when the program exits.
+// Every thread appends to its own buffer without locking; names must outlive the program (string literals).
+class Trace {
+  private:
+    static bool _isEnabled;
+  public:
+    static bool IsEnabled() { return _isEnabled; }
+    static void Enable(const std::string& path);
+
+    // Nanoseconds since the trace started
+    static uint64_t GetTimestamp();
+
+    static void AddEvent(const char* name, const char* category, uint64_t start, uint64_t end);
+    // For work that overlaps on one thread, e.g. coroutine tests in flight together
+    static void AddAsyncEvent(const char* name, const char* category, uint64_t start, uint64_t end);
+};
+
+class TraceScope {
+  private:
+    const char* _name;
+    uint64_t _start = 0;
+  public:
+    TraceScope(const char* name) : _name(name) {
+        if (Trace::IsEnabled())
+            _start = Trace::GetTimestamp();
+    }
+
+    ~TraceScope() {
+        if (Trace::IsEnabled())
+            Trace::AddEvent(_name, "scope", _start, Trace::GetTimestamp());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+} // namespace UnitTestSystem
@@ -1,13 +1,18 @@
 #pragma once
 #include "TestClassBase.h"
-#include <cmath>
+#include "Stress.h"
+#include "Benchmark.h"
+#include "Complexity.h"
+#include "Trace.h"
+#include "Snapshot.h"
+#include "Property.h"
 
 #define ASSERT(exp) if(!(exp)) throw UnitTestSystem::Assert(__LINE__, #exp)
 
 #define TEST_MODULE(name)                                                                                          \
 class name : public UnitTestSystem::Base<name> {                                                                   \
   public:                                                                                                          \
-    static std::string GetName() { return #name; }                                                                 \
+    static const char* GetName() { return #name; }                                                                 \
 };                                                                                                                 \
 namespace UnitTestSystem::internal_namespace_##name  {                                                             \
 using CurrentModule = name;                                                                                        \
@@ -22,12 +27,65 @@ void name()
 #define TEST_FUNCTION(name) TEST_FUNCTION_BASE(name, false)
 #define TEST_FUNCTION_TIME_MEASURING(name) TEST_FUNCTION_BASE(name, true)
 
+// Fails the test when its peak RSS grows by more than maxPeakResidentBytes or it takes more than maxCpuMilliseconds
+// of CPU time (user + system, all threads). 0 disables a limit.
+#define TEST_FUNCTION_WITH_LIMITS(name, maxPeakResidentBytes, maxCpuMilliseconds)                                  \
+void name();                                                                                                       \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, name, false,                         \
+    UnitTestSystem::ResourceLimits{(uint64_t)(maxPeakResidentBytes), (uint64_t)(maxCpuMilliseconds) * 1000000});   \
+void name()                                                                                                        \
+
+// The body must co_await or co_return at least once. Awaitables: Sleep, Yield, Event and other Task coroutines.
+#define TEST_COROUTINE_BASE(name, timeMeasuring)                                                                   \
+UnitTestSystem::Task name();                                                                                       \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, name, timeMeasuring);                \
+UnitTestSystem::Task name()                                                                                        \
+
+#define TEST_COROUTINE(name) TEST_COROUTINE_BASE(name, false)
+#define TEST_COROUTINE_TIME_MEASURING(name) TEST_COROUTINE_BASE(name, true)
+
+#define STRESS_FUNCTION(name, threadsCount)                                                                        \
+void name();                                                                                                       \
+void stress_##name() { UnitTestSystem::RunStress(name, threadsCount); }                                            \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, stress_##name, false);               \
+void name()                                                                                                        \
+
+#define BENCHMARK_THROUGHPUT(name, maxThreadsCount)                                                                \
+void name();                                                                                                       \
+void benchmark_##name() { UnitTestSystem::RunThroughputBenchmark(name, maxThreadsCount); }                         \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, benchmark_##name, true);             \
+void name()                                                                                                        \
+
+// complexity is one of O1, OLogN, ON, ONLogN, ON2; the body gets the input size as n
+#define BENCHMARK_COMPLEXITY(name, complexity, ...)                                                                \
+void name(size_t n);                                                                                               \
+void complexity_##name() {                                                                                         \
+    UnitTestSystem::CheckComplexity(name, UnitTestSystem::Complexity::complexity, {__VA_ARGS__}, __LINE__);        \
+}                                                                                                                  \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, complexity_##name, true);            \
+void name(size_t n)                                                                                                \
+
+
+// Checks the body against many generated inputs. The generators are IntegerGenerator, StringGenerator, VectorGenerator
+// or any class with the same members; the body gets their values as a tuple: const auto& [a, b] = values;
+#define PROPERTY_TEST(name, ...)                                                                                   \
+static auto generators_##name() { return std::make_tuple(__VA_ARGS__); }                                           \
+void name(const UnitTestSystem::PropertyValues<decltype(generators_##name())>& values);                            \
+void property_##name() { UnitTestSystem::PropertyChecker(#name, generators_##name(), name).Run(); }                \
+static UnitTestSystem::FunctionRegister<CurrentModule> register_##name(#name, property_##name, false);             \
+void name(const UnitTestSystem::PropertyValues<decltype(generators_##name())>& values)                             \
+
+// Records the enclosing block as a span on the --trace timeline, the name must be a string literal
+#define TRACE_SCOPE(name) UnitTestSystem::TraceScope TRACE_SCOPE_VARIABLE(__LINE__)(name)
+#define TRACE_SCOPE_VARIABLE(line) TRACE_SCOPE_CONCAT(traceScope_, line)
+#define TRACE_SCOPE_CONCAT(a, b) a##b
 
 #define MUST_BE_TRUE(exp) MustBeTrue(exp, __LINE__, #exp)
 #define MUST_BE_FALSE(exp) MustBeFalse(exp, __LINE__, #exp)
 
 #define MUST_BE_EQUAL(a, b) MustBeEqual(a, b, __LINE__, #a, #b)
 #define MUST_BE_CLOSE_DOUBLES(a, b) MustBeCloseDoubles(a, b, __LINE__, #a, #b)
+#define MUST_MATCH_SNAPSHOT(buffer, path) MustMatchSnapshot(buffer, path, __LINE__, #buffer)
 
 #define MUST_THROW_EXCEPTION(...)                                                                                  \
 try {                                                                                                              \
@@ -1,3 +1,9 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <typeinfo>
+#include <vector>
 #include <thread>
 #include "UnitTestSystem.h"
 
@@ -83,6 +89,71 @@ TEST_MODULE(FirstModule) {
         using namespace std::chrono_literals;
         std::this_thread::sleep_for(0.1s);
     }
+    
+    TEST_FUNCTION_WITH_LIMITS(WithinLimits, 64 << 20, 1000) {
+        std::vector<char> buffer(1 << 20, 1);
+        MUST_BE_EQUAL(buffer.back(), 1);
+    }
+
+    TEST_FUNCTION_WITH_LIMITS(PeakMemoryOverLimit, 1 << 20, 0) {
+        std::vector<char> buffer(16 << 20, 1);
+        MUST_BE_EQUAL(buffer.back(), 1);
+    }
+
+    TEST_FUNCTION_WITH_LIMITS(CpuTimeOverLimit, 0, 5) {
+        UnitTestSystem::Timer timer;
+        while (timer.GetNanoseconds() < 20000000) {}
+    }
+    
+    std::string WriteSnapshot(const char* name, const std::string& content) {
+        const auto path = (std::filesystem::temp_directory_path() / name).string();
+        std::ofstream(path, std::ios::binary) << content;
+        return path;
+    }
+
+    TEST_FUNCTION(Snapshot) {
+        std::string expected;
+        for (int i = 0; i < 10000; ++i)
+            expected += "0123456789";
+        const auto path = WriteSnapshot("UnitTestSystemSnapshot.txt", expected);
+
+        std::string output;
+        for (int i = 0; i < 100000; ++i)
+            output += (char)('0' + i % 10);
+        MUST_MATCH_SNAPSHOT(output, path);
+    }
+
+    TEST_FUNCTION(SnapshotMismatch) {
+        const auto path = WriteSnapshot("UnitTestSystemSnapshotMismatch.txt", "{\"name\": \"snapshot\", \"size\": 42}\n");
+        const std::string output = "{\"name\": \"snapshot\", \"size\": 43}\n";
+        MUST_MATCH_SNAPSHOT(output, path);
+    }
+    
+    PROPERTY_TEST(ReverseTwice, VectorGenerator(IntegerGenerator<int>(-1000, 1000), 0, 100)) {
+        const auto& [vector] = values;
+        auto reversed = vector;
+        std::reverse(reversed.begin(), reversed.end());
+        std::reverse(reversed.begin(), reversed.end());
+        MUST_BE_TRUE(reversed == vector);
+    }
+
+    PROPERTY_TEST(SumIsSmall, VectorGenerator(IntegerGenerator<int>(0, 50), 0, 20), StringGenerator(0, 10)) {
+        const auto& [vector, text] = values;
+        int sum = 0;
+        for (const auto value : vector)
+            sum += value;
+        MUST_BE_TRUE(sum + (int)text.length() < 100);
+    }
+    
+    TEST_FUNCTION(TraceScopes) {
+        using namespace std::chrono_literals;
+        {
+            TRACE_SCOPE("prepare");
+            std::this_thread::sleep_for(1ms);
+        }
+        TRACE_SCOPE("check");
+        MUST_BE_TRUE(true);
+    }
 
     TEST_FUNCTION_TIME_MEASURING(TimeNoIfError) {
         using namespace std::chrono_literals;
@@ -95,6 +166,84 @@ TEST_MODULE(FirstModule) {
         std::this_thread::sleep_for(0.1s);
         auto a = new char;
     }
+    
+    STRESS_FUNCTION(Stress, 4) {
+        static std::atomic<int> counter = 0;
+        for (int i = 0; i < 1000; ++i)
+            ++counter;
+        MUST_BE_TRUE(counter > 0);
+    }
+    
+    STRESS_FUNCTION(StressError, 4) {
+        static std::atomic<int> counter = 0;
+        MUST_BE_TRUE(++counter < 4);
+    }
+    
+    TEST_COROUTINE_TIME_MEASURING(CoroutineSleep) {
+        using namespace std::chrono_literals;
+        co_await Sleep(100ms);
+    }
+    
+    TEST_COROUTINE_TIME_MEASURING(CoroutineSleepInParallel) {
+        using namespace std::chrono_literals;
+        co_await Sleep(100ms);
+    }
+    
+    TEST_COROUTINE(CoroutineEvent) {
+        using namespace std::chrono_literals;
+        Event event;
+        std::thread thread([&event] {
+            std::this_thread::sleep_for(10ms);
+            event.Set();
+        });
+        co_await event;
+        thread.join();
+    }
+    
+    TEST_COROUTINE(CoroutineError) {
+        co_await Yield();
+        MUST_BE_TRUE(false);
+    }
+    
+    TEST_FUNCTION(ComplexityFitOfNoisySeries) {
+        const std::vector<size_t> sizes = {100, 400, 1600, 6400};
+        const double noise[] = {1.08, 0.93, 1.05, 0.96};
+        std::vector<double> linear;
+        std::vector<double> quadratic;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            linear.push_back(3.0 * sizes[i] * noise[i]);
+            quadratic.push_back(0.5 * sizes[i] * sizes[i] * noise[i]);
+        }
+        MUST_BE_TRUE(FitComplexity(sizes, linear, Complexity::ON).complexity == Complexity::ON);
+        MUST_BE_TRUE(FitComplexity(sizes, quadratic, Complexity::ONLogN).complexity == Complexity::ON2);
+        MUST_BE_TRUE(FitComplexity(sizes, quadratic, Complexity::ON2).complexity == Complexity::ON2);
+    }
+    
+    BENCHMARK_COMPLEXITY(ComplexityLinear, ON, 1000, 4000, 16000, 64000) {
+        std::vector<int> values(n, 1);
+        ComplexityTimer::Restart();
+        volatile int sum = 0;
+        for (const auto value : values)
+            sum = sum + value;
+    }
+    
+    BENCHMARK_COMPLEXITY(ComplexityWorseThanDeclared, O1, 100, 400, 1600) {
+        volatile size_t count = 0;
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j)
+                count = count + 1;
+    }
+    
+    BENCHMARK_COMPLEXITY(ComplexityTooFewSizes, ON, 1000, 1000, 4000) {
+        volatile size_t count = 0;
+        for (size_t i = 0; i < n; ++i)
+            count = count + 1;
+    }
+    
+    BENCHMARK_THROUGHPUT(Throughput, 4) {
+        static std::atomic<uint64_t> counter = 0;
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 
@@ -102,7 +251,8 @@ TEST_MODULE(SecondEmptyModule) {
 }
 
 int main(int argc, const char * argv[]) {
-    FirstModule::Run();
-    SecondEmptyModule::Run();
+    const auto options = UnitTestSystem::Options::Parse(argc, argv);
+    FirstModule::Run(options);
+    SecondEmptyModule::Run(options);
     return 0;
 }